@@ -15,6 +15,11 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "plugin.hpp"
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <mutex>
 #include <stdexcept>
 #include <thread>
 #include "json/json.hpp"
@@ -22,17 +27,58 @@
 #include "source-chat.hpp"
 #include "source-labels.hpp"
 #include "ui/ui.hpp"
+#include "util/api.hpp"
+#include "util/asset-loader.hpp"
+#include "util/blob-store.hpp"
 #include "util/curl.hpp"
+#include "util/http-cache.hpp"
+#include "util/http-engine.hpp"
+#include "util/http-statistics.hpp"
+#include "util/retry.hpp"
 #include "util/systeminfo.hpp"
+#include "util/throttle.hpp"
 
 constexpr std::string_view CFG_UNIQUE_ID = "UniqueId";
 
+constexpr std::string_view I18N_PLACEHOLDER = "Placeholder.Connecting";
+
+// Back off from up to 500ms to up to 5 minutes between attempts at acquiring a machine token.
+constexpr auto UNIQUE_ID_RETRY_INITIAL = std::chrono::milliseconds(500);
+constexpr auto UNIQUE_ID_RETRY_MAXIMUM = std::chrono::minutes(5);
+
 MODULE_EXPORT bool obs_module_load(void)
 try {
 	// Initialize Configuration
 	own3d::configuration::initialize();
 
-	// Retrieve unique Machine Id.
+	// Initialize libcurl once, as doing so is not thread-safe.
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	// Initialize shared network cache, so that all requests can reuse DNS lookups and TLS sessions.
+	own3d::util::curl_share::initialize();
+
+	// Initialize persistent response cache, so that API data is available even if the server is not.
+	own3d::util::http_cache::initialize();
+
+	// Initialize theme file store, which keeps files that several themes share only once.
+	own3d::util::blob_store::initialize();
+
+	// Initialize theme asset loader, which extracts files of themes once they are needed.
+	own3d::util::asset_loader::initialize();
+
+	// Initialize circuit breaker, which stops requests to endpoints that are down.
+	own3d::util::circuit_breaker::initialize();
+
+	// Initialize bandwidth throttle, which keeps background transfers from interfering with a live stream.
+	own3d::util::throttle::initialize();
+
+	// Initialize network statistics, which record how long each phase of a request takes.
+	own3d::util::http_statistics::initialize();
+
+	// Initialize transfer engine, which drives all network requests from a single thread.
+	own3d::util::http_engine::initialize();
+
+	// Start acquiring the unique Machine Id in the background.
 	own3d::get_unique_identifier();
 
 	// Initialize UI
@@ -56,6 +102,33 @@ try {
 
 MODULE_EXPORT void obs_module_unload(void)
 try {
+	// Finalize transfer engine.
+	own3d::util::http_engine::finalize();
+
+	// Finalize network statistics, which logs a last summary.
+	own3d::util::http_statistics::finalize();
+
+	// Finalize circuit breaker.
+	own3d::util::circuit_breaker::finalize();
+
+	// Finalize bandwidth throttle.
+	own3d::util::throttle::finalize();
+
+	// Finalize theme asset loader, which may still be extracting files into the store.
+	own3d::util::asset_loader::finalize();
+
+	// Finalize theme file store.
+	own3d::util::blob_store::finalize();
+
+	// Finalize persistent response cache.
+	own3d::util::http_cache::finalize();
+
+	// Finalize shared network cache.
+	own3d::util::curl_share::finalize();
+
+	// Finalize libcurl, now that nothing uses it anymore.
+	curl_global_cleanup();
+
 	// Finalize Configuration
 	own3d::configuration::finalize();
 } catch (...) {
@@ -150,21 +223,6 @@ std::string dont_rn0rnrn_me(std::string str)
 	return str;
 }
 
-size_t uuid_write_cb(void* buffer, size_t size, size_t count, std::string* uuid, own3d::util::curl* curl)
-{
-	int32_t http_code = 0;
-	curl->get_info(CURLINFO_RESPONSE_CODE, http_code);
-	switch (http_code) {
-	case 200:
-		*uuid = std::string(reinterpret_cast<const char*>(buffer), reinterpret_cast<const char*>(buffer) + count);
-		break;
-	default:
-		*uuid = "";
-		break;
-	}
-	return size * count;
-}
-
 bool own3d::is_sandbox()
 {
 	constexpr std::string_view KEY = "sandbox";
@@ -191,6 +249,24 @@ std::string own3d::get_web_endpoint(std::string_view const args /*= ""*/)
 {
 	constexpr std::string_view URL_ENDPOINT         = "https://own3d.pro/";
 	constexpr std::string_view URL_ENDPOINT_SANDBOX = "https://sandbox.own3d.pro/";
+	constexpr std::string_view ENV_ENDPOINT         = "OWN3D_ENDPOINT";
+	constexpr std::string_view CFG_ENDPOINT         = "endpoint";
+
+	// Allow pointing the plugin at a different server, for example the stand-in server in tools/.
+	std::string override_endpoint;
+	if (const char* env = getenv(ENV_ENDPOINT.data()); env && (env[0] != '\0')) {
+		override_endpoint = env;
+	} else if (auto cfg = own3d::configuration::instance(); cfg) {
+		if (const char* value = obs_data_get_string(cfg->get().get(), CFG_ENDPOINT.data()); value) {
+			override_endpoint = value;
+		}
+	}
+	if (override_endpoint.length() > 0) {
+		if (override_endpoint.back() != '/') {
+			override_endpoint.push_back('/');
+		}
+		return override_endpoint.append(args);
+	}
 
 	std::vector<char> buffer(65535);
 	if (is_sandbox()) {
@@ -201,6 +277,27 @@ std::string own3d::get_web_endpoint(std::string_view const args /*= ""*/)
 	return std::string(buffer.data(), buffer.data() + buffer.size());
 }
 
+std::string own3d::get_placeholder_url()
+{
+	// Matches the default dark theme of OBS Studio, so that it doesn't flash white.
+	std::string html = "<html><body style=\"margin:0;height:100vh;display:flex;align-items:center;"
+					   "justify-content:center;background:#1f1e1f;color:#dedede;font-family:sans-serif\">";
+	html += D_TRANSLATE(I18N_PLACEHOLDER.data());
+	html += "</body></html>";
+
+	std::string url = "data:text/html;charset=utf-8,";
+	for (unsigned char c : html) {
+		if (isalnum(c) || (c == '-') || (c == '_') || (c == '.') || (c == '~')) {
+			url.push_back(static_cast<char>(c));
+		} else {
+			char buf[4];
+			snprintf(buf, sizeof(buf), "%%%02X", c);
+			url.append(buf);
+		}
+	}
+	return url;
+}
+
 bool own3d::testing_enabled()
 {
 	// To protect against prying eyes which we don't want to find this, this is a
@@ -234,7 +331,7 @@ std::string_view own3d::testing_archive_path()
 	return obs_data_get_string(cfg.get(), KEY.data());
 }
 
-static std::string request_unique_identifier()
+static nlohmann::json unique_identifier_request_data()
 {
 	auto j_ = nlohmann::json::object();
 	{
@@ -287,69 +384,124 @@ static std::string request_unique_identifier()
 		j_["system"] = j_system;
 	}
 
-	CURLcode    res = CURLE_AGAIN;
-	std::string id;
-	for (size_t n = 0; (n < 10) && (res != CURLE_OK); n++) {
-		own3d::util::curl rq;
-		std::string       args = j_.dump();
-		rq.set_option(CURLOPT_USERAGENT, OWN3D_USER_AGENT);
-		rq.set_option(CURLOPT_URL, own3d::get_api_endpoint("machine-tokens/issue"));
-		rq.set_option(CURLOPT_POSTFIELDS, args.c_str());
-		rq.set_option(CURLOPT_POST, true);
-		rq.set_header("Content-Type", "application/json");
-
-		rq.set_write_callback(
-			std::bind(uuid_write_cb, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, &id, &rq));
-
-		if (res = rq.perform(); res != CURLE_OK) {
-			DLOG_WARNING("Attempt %llu at retrieving a unique machine id failed.", n);
-		} else {
-			if (id.length() != 0) {
-				DLOG_WARNING("Attempt %llu at retrieving a unique machine id returned empty id.", n);
-				break;
-			}
+	return j_;
+}
+
+static std::recursive_mutex                                 unique_identifier_lock;
+static std::string                                          unique_identifier;
+static bool                                                 unique_identifier_loaded  = false;
+static bool                                                 unique_identifier_pending = false;
+static std::map<void*, own3d::unique_identifier_callback_t> unique_identifier_callbacks;
+// Owner whose callback is running right now, which remove_unique_identifier_callback() waits for.
+static std::condition_variable_any unique_identifier_cv;
+static void*                       unique_identifier_running = nullptr;
+static std::thread::id             unique_identifier_running_thread;
+
+static void on_unique_identifier(std::string id)
+{
+	std::map<void*, own3d::unique_identifier_callback_t> callbacks;
+	{
+		std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+		unique_identifier_pending = false;
+		unique_identifier         = id;
+
+		if (auto cfg = own3d::configuration::instance(); cfg) {
+			obs_data_set_string(cfg->get().get(), CFG_UNIQUE_ID.data(), unique_identifier.c_str());
+			cfg->save();
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-	}
-	if (res != CURLE_OK) {
-		DLOG_ERROR("Failed to acquire unique machine id, error code %lld. Functionality disabled.", res);
-#ifndef _DEBUG
-		throw std::runtime_error("Failed to acquire unique machine id.");
-#endif
-	}
+		DLOG_INFO("Acquired unique machine token.");
 
-	if (id.size() == 0) {
-		DLOG_ERROR("API returned an empty machine id. Functionality disabled.");
-#ifndef _DEBUG
-		throw std::runtime_error("Failed to acquire unique machine id.");
-#endif
+		// Iterate over a copy, so that callbacks may remove themselves.
+		callbacks = unique_identifier_callbacks;
 	}
 
-	return id;
+	// Callbacks update sources, which must not happen while holding the lock that everyone else needs.
+	for (auto kv : callbacks) {
+		{
+			std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+			if (unique_identifier_callbacks.count(kv.first) == 0)
+				continue;
+			unique_identifier_running        = kv.first;
+			unique_identifier_running_thread = std::this_thread::get_id();
+		}
+
+		try {
+			kv.second(id);
+		} catch (std::exception const& ex) {
+			DLOG_ERROR("Machine token handler failed with error: %s", ex.what());
+		}
+
+		{
+			std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+			unique_identifier_running = nullptr;
+		}
+		unique_identifier_cv.notify_all();
+	}
 }
 
-std::string_view own3d::get_unique_identifier()
+static void request_unique_identifier(std::shared_ptr<own3d::util::backoff> retry)
 {
-	auto             cfg = own3d::configuration::instance()->get();
-	std::string_view id  = obs_data_get_string(cfg.get(), CFG_UNIQUE_ID.data());
-
-	if (id.length() == 0) { // Id is invalid, request a new one.
-		std::string idv = request_unique_identifier();
-		if (idv.length() > 0) {
-			obs_data_set_string(cfg.get(), CFG_UNIQUE_ID.data(), idv.c_str());
-			id = obs_data_get_string(cfg.get(), CFG_UNIQUE_ID.data());
-			own3d::configuration::instance()->save();
-			DLOG_INFO("Acquired unique machine token.");
-		} else {
-			DLOG_ERROR("Failed to acquire machine token.");
+	auto url  = own3d::get_api_endpoint("machine-tokens/issue");
+	auto data = unique_identifier_request_data().dump();
+	own3d::util::request_machine_token(url, data, retry, [](std::string id) {
+		if (id.length() > 0) {
+			on_unique_identifier(id);
+			return;
 		}
+
+		// Give up for now, the next call to get_unique_identifier() tries again.
+		std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+		unique_identifier_pending = false;
+	});
+}
+
+std::string own3d::get_unique_identifier()
+{
+	std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+	if (!unique_identifier_loaded) {
+		auto cfg                 = own3d::configuration::instance()->get();
+		unique_identifier        = obs_data_get_string(cfg.get(), CFG_UNIQUE_ID.data());
+		unique_identifier_loaded = true;
 	}
 
-	return id;
+	if ((unique_identifier.length() == 0) && !unique_identifier_pending) {
+		// Id is invalid, request a new one without holding up the caller.
+		unique_identifier_pending = true;
+		request_unique_identifier(
+			std::make_shared<own3d::util::backoff>(UNIQUE_ID_RETRY_INITIAL, UNIQUE_ID_RETRY_MAXIMUM));
+	}
+
+	return unique_identifier;
 }
 
 void own3d::reset_unique_identifier()
 {
-	obs_data_unset_user_value(own3d::configuration::instance()->get().get(), CFG_UNIQUE_ID.data());
-	own3d::configuration::instance()->save();
+	{
+		std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+		unique_identifier.clear();
+		unique_identifier_loaded = true;
+		obs_data_unset_user_value(own3d::configuration::instance()->get().get(), CFG_UNIQUE_ID.data());
+		own3d::configuration::instance()->save();
+	}
+
+	// Immediately start acquiring a new one.
+	own3d::get_unique_identifier();
+}
+
+void own3d::add_unique_identifier_callback(void* owner, unique_identifier_callback_t callback)
+{
+	std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+	unique_identifier_callbacks.insert_or_assign(owner, callback);
+}
+
+void own3d::remove_unique_identifier_callback(void* owner)
+{
+	std::unique_lock<std::recursive_mutex> lock(unique_identifier_lock);
+	unique_identifier_callbacks.erase(owner);
+
+	// Wait for the callback to finish, unless it is the one removing itself.
+	unique_identifier_cv.wait(lock, [owner]() {
+		return (unique_identifier_running != owner)
+			   || (unique_identifier_running_thread == std::this_thread::get_id());
+	});
 }
@@ -17,6 +17,7 @@
 #pragma once
 #include <cinttypes>
 #include <filesystem>
+#include <functional>
 #include <string>
 #include <vector>
 #include "version.hpp"
@@ -113,15 +114,35 @@ namespace own3d {
 
 	std::string get_web_endpoint(std::string_view const args = "");
 
+	/** URL of a page to show in place of OWN3D content until the machine token is known. */
+	std::string get_placeholder_url();
+
 	bool testing_enabled();
 
 	std::string_view testing_archive_name();
 
 	std::string_view testing_archive_path();
 
-	std::string_view get_unique_identifier();
+	typedef std::function<void(std::string_view)> unique_identifier_callback_t;
+
+	/** Retrieve the unique machine token.
+	 *
+	 * Never blocks: if no token is known yet, an empty string is returned and a new
+	 * one is requested in the background. Use add_unique_identifier_callback() to be
+	 * notified once it arrives. Returns a copy, as the token may be replaced at any time.
+	 */
+	std::string get_unique_identifier();
 
 	void reset_unique_identifier();
+
+	/** Invoke the callback whenever a new machine token has been acquired.
+	 *
+	 * The callback runs on the network thread, and is guaranteed not to be running
+	 * anymore once remove_unique_identifier_callback() returns.
+	 */
+	void add_unique_identifier_callback(void* owner, unique_identifier_callback_t callback);
+
+	void remove_unique_identifier_callback(void* owner);
 } // namespace own3d
 
 #define D_TRANSLATE(x) obs_module_text(x)
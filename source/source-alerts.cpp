@@ -89,9 +89,15 @@ own3d::source::alert_instance::alert_instance(obs_data_t* data, obs_source_t* se
 
 	// Trigger a load event.
 	obs_source_load(_browser.get());
+
+	// Point the browser at the real content once the machine token is known.
+	own3d::add_unique_identifier_callback(this, [this](std::string_view) { obs_source_update(_self, nullptr); });
 }
 
-own3d::source::alert_instance::~alert_instance() {}
+own3d::source::alert_instance::~alert_instance()
+{
+	own3d::remove_unique_identifier_callback(this);
+}
 
 void own3d::source::alert_instance::apply_settings(obs_data_t* data)
 {
@@ -164,9 +170,19 @@ bool own3d::source::alert_instance::parse_size(std::string_view text)
 
 bool own3d::source::alert_instance::parse_alert_type()
 {
+	// Show nothing until the machine token is known, we are updated again once it is.
+	std::string token = own3d::get_unique_identifier();
+	if (token.length() == 0) {
+		if (_url.compare("about:blank") == 0) {
+			return false;
+		}
+		_url = "about:blank";
+		return true;
+	}
+
 	std::vector<char> buffer(2048);
 	std::string       format = own3d::get_api_endpoint("obs/browser-source/%s/components/alerts");
-	buffer.resize(snprintf(buffer.data(), buffer.size(), format.c_str(), own3d::get_unique_identifier().data()));
+	buffer.resize(snprintf(buffer.data(), buffer.size(), format.c_str(), token.data()));
 
 	std::string url = std::string(buffer.data(), buffer.data() + buffer.size());
 	if (_url.compare(url) == 0) {
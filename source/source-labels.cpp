@@ -146,9 +146,15 @@ own3d::source::label_instance::label_instance(obs_data_t* data, obs_source_t* se
 
 	// Trigger a load event.
 	obs_source_load(_browser.get());
+
+	// Point the browser at the real content once the machine token is known.
+	own3d::add_unique_identifier_callback(this, [this](std::string_view) { obs_source_update(_self, nullptr); });
 }
 
-own3d::source::label_instance::~label_instance() {}
+own3d::source::label_instance::~label_instance()
+{
+	own3d::remove_unique_identifier_callback(this);
+}
 
 void own3d::source::label_instance::apply_settings(obs_data_t* data)
 {
@@ -209,9 +215,19 @@ bool own3d::source::label_instance::parse_size(std::string_view text)
 
 bool own3d::source::label_instance::parse_label(std::string_view type, uint32_t color, std::string_view font)
 {
+	// Show nothing until the machine token is known, we are updated again once it is.
+	std::string token = own3d::get_unique_identifier();
+	if (token.length() == 0) {
+		if (_url.compare("about:blank") == 0) {
+			return false;
+		}
+		_url = "about:blank";
+		return true;
+	}
+
 	std::vector<char> buffer(2048);
 	std::string       format = own3d::get_api_endpoint("obs/browser-source/%s/components/%s?font-family=%s&color=%08X");
-	buffer.resize(snprintf(buffer.data(), buffer.size(), format.c_str(), own3d::get_unique_identifier().data(),
+	buffer.resize(snprintf(buffer.data(), buffer.size(), format.c_str(), token.data(),
 						   type.data(), font.data(), color));
 
 	std::string url = std::string(buffer.data(), buffer.data() + buffer.size());
@@ -26,7 +26,10 @@ constexpr std::string_view own3d_url_path_theme = "obs?machine-token=";
 
 constexpr std::string_view I18N_THEME_BROWSER_TITLE = "ThemeBrowser.Title";
 
-own3d::ui::browser::~browser() {}
+own3d::ui::browser::~browser()
+{
+	own3d::remove_unique_identifier_callback(this);
+}
 
 own3d::ui::browser::browser() : QDialog(reinterpret_cast<QWidget*>(obs_frontend_get_main_window()))
 {
@@ -60,6 +63,11 @@ own3d::ui::browser::browser() : QDialog(reinterpret_cast<QWidget*>(obs_frontend_
 	// Connect signals.
 	connect(_cef_widget, &QCefWidget::urlChanged, this, &own3d::ui::browser::url_changed);
 	connect(_cef_widget, &QCefWidget::titleChanged, this, &own3d::ui::browser::title_changed);
+	connect(this, &own3d::ui::browser::unique_identifier_changed, this,
+			&own3d::ui::browser::on_unique_identifier_changed, Qt::QueuedConnection);
+
+	// Replace the placeholder once the machine token arrives.
+	own3d::add_unique_identifier_callback(this, [this](std::string_view) { emit unique_identifier_changed(); });
 }
 
 void own3d::ui::browser::show()
@@ -81,10 +89,15 @@ void own3d::ui::browser::closeEvent(QCloseEvent*)
 
 QUrl own3d::ui::browser::generate_url()
 {
+	std::string token = own3d::get_unique_identifier();
+	if (token.length() == 0) {
+		return QUrl(QString::fromStdString(own3d::get_placeholder_url()));
+	}
+
 	QUrl url;
 	url.setUrl(QString::fromStdString(own3d::get_web_endpoint("obs")));
 	QUrlQuery urlq;
-	urlq.addQueryItem("machine-token", QString::fromUtf8(own3d::get_unique_identifier().data()));
+	urlq.addQueryItem("machine-token", QString::fromUtf8(token.data(), static_cast<int>(token.length())));
 	urlq.addQueryItem("version", OWN3D_VERSION_STRING);
 	url.setQuery(urlq);
 	return url;
@@ -139,3 +152,10 @@ void own3d::ui::browser::title_changed(const QString& title)
 	}
 	setWindowTitle(QString::fromStdString(sstr.str()));
 }
+
+void own3d::ui::browser::on_unique_identifier_changed()
+{
+	if (isVisible()) {
+		_cef_widget->setURL(generate_url().toString().toStdString());
+	}
+}
@@ -46,10 +46,12 @@ namespace own3d::ui {
 		; // Needed by some linters.
 		void url_changed(const QString& url);
 		void title_changed(const QString& title);
+		void on_unique_identifier_changed();
 
 		signals:
 		; // Needed by some linters.
 		void selected(const QUrl& download_url, const QString& name, const QString& hash);
 		void cancelled();
+		void unique_identifier_changed();
 	};
 } // namespace own3d::ui
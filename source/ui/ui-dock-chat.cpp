@@ -28,10 +28,7 @@ constexpr std::string_view CFG_CHAT_FLOATING = "dock.chat.floating";
 
 own3d::ui::dock::chat::chat() : QDockWidget(reinterpret_cast<QWidget*>(obs_frontend_get_main_window()))
 {
-	std::string token = std::string(own3d::get_unique_identifier());
-	std::string url   = own3d::get_web_endpoint("popout/0/chat?machine-token=" + token);
-
-	_browser = obs::browser::instance()->create_widget(this, url);
+	_browser = obs::browser::instance()->create_widget(this, generate_url());
 	_browser->setMinimumSize(300, 170);
 
 	setWidget(_browser);
@@ -56,12 +53,28 @@ own3d::ui::dock::chat::chat() : QDockWidget(reinterpret_cast<QWidget*>(obs_front
 	// Connect Signals
 	connect(this, &QDockWidget::visibilityChanged, this, &chat::on_visibilityChanged);
 	connect(this, &QDockWidget::topLevelChanged, this, &chat::on_topLevelChanged);
+	connect(this, &chat::unique_identifier_changed, this, &chat::on_unique_identifier_changed, Qt::QueuedConnection);
+
+	// The machine token may only arrive after the dock was created.
+	own3d::add_unique_identifier_callback(this, [this](std::string_view) { emit unique_identifier_changed(); });
 
 	// Hide initially.
 	hide();
 }
 
-own3d::ui::dock::chat::~chat() {}
+own3d::ui::dock::chat::~chat()
+{
+	own3d::remove_unique_identifier_callback(this);
+}
+
+std::string own3d::ui::dock::chat::generate_url()
+{
+	std::string token = own3d::get_unique_identifier();
+	if (token.length() == 0) {
+		return own3d::get_placeholder_url();
+	}
+	return own3d::get_web_endpoint("popout/0/chat?machine-token=" + token);
+}
 
 QAction* own3d::ui::dock::chat::add_obs_dock()
 {
@@ -102,3 +115,8 @@ void own3d::ui::dock::chat::on_topLevelChanged(bool topLevel)
 	obs_data_set_bool(data.get(), CFG_CHAT_FLOATING.data(), topLevel);
 	cfg->save();
 }
+
+void own3d::ui::dock::chat::on_unique_identifier_changed()
+{
+	_browser->setURL(generate_url());
+}
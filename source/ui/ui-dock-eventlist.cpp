@@ -28,10 +28,7 @@ constexpr std::string_view CFG_EVENTLIST_FLOATING = "dock.eventlist.floating";
 
 own3d::ui::dock::eventlist::eventlist() : QDockWidget(reinterpret_cast<QWidget*>(obs_frontend_get_main_window()))
 {
-	std::string token = std::string(own3d::get_unique_identifier());
-	std::string url   = own3d::get_web_endpoint("popout/0/event-list?machine-token=" + token);
-
-	_browser = obs::browser::instance()->create_widget(this, url);
+	_browser = obs::browser::instance()->create_widget(this, generate_url());
 	_browser->setMinimumSize(300, 170);
 
 	setWidget(_browser);
@@ -56,12 +53,29 @@ own3d::ui::dock::eventlist::eventlist() : QDockWidget(reinterpret_cast<QWidget*>
 	// Connect Signals
 	connect(this, &QDockWidget::visibilityChanged, this, &eventlist::on_visibilityChanged);
 	connect(this, &QDockWidget::topLevelChanged, this, &eventlist::on_topLevelChanged);
+	connect(this, &eventlist::unique_identifier_changed, this, &eventlist::on_unique_identifier_changed,
+			Qt::QueuedConnection);
+
+	// The machine token may only arrive after the dock was created.
+	own3d::add_unique_identifier_callback(this, [this](std::string_view) { emit unique_identifier_changed(); });
 
 	// Hide initially.
 	hide();
 }
 
-own3d::ui::dock::eventlist::~eventlist() {}
+own3d::ui::dock::eventlist::~eventlist()
+{
+	own3d::remove_unique_identifier_callback(this);
+}
+
+std::string own3d::ui::dock::eventlist::generate_url()
+{
+	std::string token = own3d::get_unique_identifier();
+	if (token.length() == 0) {
+		return own3d::get_placeholder_url();
+	}
+	return own3d::get_web_endpoint("popout/0/event-list?machine-token=" + token);
+}
 
 QAction* own3d::ui::dock::eventlist::add_obs_dock()
 {
@@ -102,3 +116,8 @@ void own3d::ui::dock::eventlist::on_topLevelChanged(bool topLevel)
 	obs_data_set_bool(data.get(), CFG_EVENTLIST_FLOATING.data(), topLevel);
 	cfg->save();
 }
+
+void own3d::ui::dock::eventlist::on_unique_identifier_changed()
+{
+	_browser->setURL(generate_url());
+}
@@ -33,11 +33,18 @@ namespace own3d::ui::dock {
 
 		QAction* add_obs_dock();
 
+		private:
+		std::string generate_url();
+
 		protected:
 		void closeEvent(QCloseEvent* event) override;
 
 		protected Q_SLOTS:
 		void on_visibilityChanged(bool visible);
 		void on_topLevelChanged(bool topLevel);
+		void on_unique_identifier_changed();
+
+		Q_SIGNALS:
+		void unique_identifier_changed();
 	};
 } // namespace own3d::ui::dock
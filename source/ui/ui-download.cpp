@@ -15,109 +15,332 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "ui-download.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <limits>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <thread>
 #include "json/json.hpp"
 #include "plugin.hpp"
+#include "util/asset-loader.hpp"
+#include "util/blob-store.hpp"
 
 constexpr std::string_view I18N_TITLE          = "ThemeInstaller.Title";
 constexpr std::string_view I18N_STATE_WAITING  = "ThemeInstaller.State.Waiting";
 constexpr std::string_view I18N_STATE_DOWNLOAD = "ThemeInstaller.State.Download";
 constexpr std::string_view I18N_STATE_EXTRACT  = "ThemeInstaller.State.Extract";
 constexpr std::string_view I18N_STATE_INSTALL  = "ThemeInstaller.State.Install";
+constexpr std::string_view I18N_REMAINING      = "ThemeInstaller.Remaining";
+
+constexpr std::string_view CFG_THEME_LAZY = "theme.lazy";
+
+// Placeholder for the theme directory in data.json.
+constexpr std::string_view TOKEN_PATH = "<REPLACE|ME>";
+// Placeholder for the machine token in data.json.
+constexpr std::string_view TOKEN_UUID = "<machine-token>";
+
+// How long an installation waits for a machine token that is still being requested, and how often it checks.
+constexpr auto INSTALL_TOKEN_TIMEOUT  = std::chrono::seconds(60);
+constexpr auto INSTALL_TOKEN_INTERVAL = std::chrono::milliseconds(250);
+
+// How often the dialog shows the progress, which is plenty for a progress bar.
+constexpr int PROGRESS_INTERVAL_MS = 33;
+// Share of the progress bar each phase takes up.
+constexpr double_t PROGRESS_WEIGHT_DOWNLOAD = 0.6;
+constexpr double_t PROGRESS_WEIGHT_EXTRACT  = 0.3;
+constexpr double_t PROGRESS_WEIGHT_INSTALL  = 0.1;
+// Time over which throughput and the time left are averaged, so that they don't jump around.
+constexpr double_t PROGRESS_SMOOTHING = 2.0;
+
+own3d::ui::installer_progress::installer_progress()
+	: _lock(), _phase(phase::WAITING), _now(0), _total(0), _bytes(true), _last_phase(phase::WAITING), _last_now(0),
+	  _last_percent(NAN), _last_time(std::chrono::steady_clock::now()), _throughput(NAN), _rate(NAN)
+{}
+
+void own3d::ui::installer_progress::begin(phase value)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_now   = 0;
+	_total = 0;
+	_phase = value;
+}
+
+void own3d::ui::installer_progress::update(uint64_t now, uint64_t total, bool bytes)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_bytes = bytes;
+	_total = total;
+	_now   = now;
+}
+
+own3d::ui::installer_progress::snapshot own3d::ui::installer_progress::sample()
+{
+	snapshot value;
+	uint64_t now;
+	uint64_t total;
+	bool     bytes;
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		value.stage = _phase;
+		now         = _now;
+		total       = _total;
+		bytes       = _bytes;
+	}
+	double_t portion = ((total > 0) && (now <= total)) ? static_cast<double_t>(now) / static_cast<double_t>(total)
+													   : NAN;
+
+	switch (value.stage) {
+	case phase::WAITING:
+	case phase::FAILED:
+		value.percent = NAN;
+		break;
+	case phase::DOWNLOAD:
+		value.percent = std::isnan(portion) ? NAN : (portion * PROGRESS_WEIGHT_DOWNLOAD);
+		break;
+	case phase::EXTRACT:
+		value.percent = PROGRESS_WEIGHT_DOWNLOAD + (std::isnan(portion) ? 0. : (portion * PROGRESS_WEIGHT_EXTRACT));
+		break;
+	case phase::INSTALL:
+		value.percent = PROGRESS_WEIGHT_DOWNLOAD + PROGRESS_WEIGHT_EXTRACT;
+		break;
+	case phase::DONE:
+		value.percent = PROGRESS_WEIGHT_DOWNLOAD + PROGRESS_WEIGHT_EXTRACT + PROGRESS_WEIGHT_INSTALL;
+		break;
+	}
+
+	// Average over time rather than samples, so that the result doesn't depend on how often this is called.
+	auto     time    = std::chrono::steady_clock::now();
+	double_t elapsed = std::chrono::duration<double_t>(time - _last_time).count();
+	double_t alpha   = 1. - std::exp(-elapsed / PROGRESS_SMOOTHING);
+	if (value.stage != _last_phase) {
+		_throughput = NAN;
+		_last_now   = 0;
+	} else if ((elapsed > 0.) && (now >= _last_now)) {
+		double_t throughput = static_cast<double_t>(now - _last_now) / elapsed;
+		_throughput         = std::isnan(_throughput) ? throughput : (_throughput + (throughput - _throughput) * alpha);
+	}
+	if ((elapsed > 0.) && !std::isnan(value.percent) && !std::isnan(_last_percent)
+		&& (value.percent >= _last_percent)) {
+		double_t rate = (value.percent - _last_percent) / elapsed;
+		_rate         = std::isnan(_rate) ? rate : (_rate + (rate - _rate) * alpha);
+	}
+	_last_phase   = value.stage;
+	_last_now     = now;
+	_last_percent = value.percent;
+	_last_time    = time;
+
+	bool running     = (value.stage == phase::DOWNLOAD) || (value.stage == phase::EXTRACT);
+	value.throughput = (running && bytes) ? _throughput : NAN;
+	value.eta        = NAN;
+	if (!std::isnan(value.percent) && !std::isnan(_rate) && (_rate > 0.) && (value.stage != phase::DONE)) {
+		value.eta = (1. - value.percent) / _rate;
+	}
+	return value;
+}
 
 own3d::ui::installer_thread::~installer_thread() {}
 
-own3d::ui::installer_thread::installer_thread(std::string url, std::string name, std::filesystem::path path,
-											  std::filesystem::path out_path, QObject* parent)
-	: QThread(parent), _url(url), _name(name), _path(path), _out_path(out_path)
-{}
+own3d::ui::installer_thread::installer_thread(std::string url, std::string name, std::string hash,
+											  std::filesystem::path path, std::filesystem::path out_path,
+											  std::shared_ptr<installer_progress> progress, QObject* parent)
+	: QThread(parent), _name(name), _path(path), _out_path(out_path),
+	  _download(url, path, hash, "Theme '" + name + "'"), _stream(), _lazy(false), _progress(progress), _abort_lock(),
+	  _abort_cv(), _abort(false)
+{
+	if (auto cfg = own3d::configuration::instance(); cfg) {
+		auto data = cfg->get();
+		obs_data_set_default_bool(data.get(), CFG_THEME_LAZY.data(), false);
+		_lazy = obs_data_get_bool(data.get(), CFG_THEME_LAZY.data());
+	}
+}
+
+// How often a download that doesn't match the theme hash is started over.
+constexpr size_t DOWNLOAD_VERIFY_ATTEMPTS = 2;
+
+void own3d::ui::installer_thread::abort()
+{
+	_download.abort();
+	{
+		std::unique_lock<std::mutex> lock(_abort_lock);
+		_abort = true;
+	}
+	_abort_cv.notify_all();
+}
+
+void own3d::ui::installer_thread::pause_for(std::chrono::milliseconds delay)
+{
+	std::unique_lock<std::mutex> lock(_abort_lock);
+	if (_abort_cv.wait_for(lock, delay, [this]() { return _abort.load(); })) {
+		throw std::runtime_error("Installation was aborted.");
+	}
+}
+
+std::string own3d::ui::installer_thread::wait_for_unique_identifier()
+{
+	auto deadline = std::chrono::steady_clock::now() + INSTALL_TOKEN_TIMEOUT;
+	while (true) {
+		if (std::string token = own3d::get_unique_identifier(); token.length() > 0) {
+			return token;
+		}
+		if (std::chrono::steady_clock::now() >= deadline) {
+			throw std::runtime_error("Unable to install, there is no machine token for the theme to use.");
+		}
+		pause_for(INSTALL_TOKEN_INTERVAL);
+	}
+}
 
 void own3d::ui::installer_thread::run_download()
 {
-	std::ofstream             stream;
-	util::curl                curl;
-	own3d::ui::download_state state;
+	if (own3d::testing_enabled())
+		return;
 
-	if (own3d::testing_enabled()) {
-		state = download_state::DONE;
-		emit download_status(uint64_t(0), uint64_t(0), static_cast<int64_t>(state));
+	_progress->begin(installer_progress::phase::DOWNLOAD);
+	if (_download.reuse()) {
+		DLOG_INFO("Using previously downloaded and verified Theme '%s'.", _name.c_str());
 		return;
 	}
 
-	{ // Emit signal.
-		state = download_state::UNKNOWN;
-		emit download_status(uint64_t(0), uint64_t(0), static_cast<int64_t>(state));
+	_download.set_progress_callback([this](uint64_t now, uint64_t total) { _progress->update(now, total); });
+	_download.set_advance_callback([this](uint64_t offset) {
+		if (_stream) {
+			_stream->advance(offset);
+		}
+	});
+	for (size_t attempt = 1; true; attempt++) {
+		// Extract what has arrived while the rest is still downloading, unless only some of it is wanted.
+		if (!_lazy) {
+			_stream = std::make_unique<util::zip_stream>(_path, _out_path);
+		}
+
+		_download.fetch();
+
+		// Catch damage here, instead of halfway through extracting the theme.
+		if (_download.verify()) {
+			if (_stream)
+				_stream->finish();
+			break;
+		}
+
+		// Whatever was extracted from the damaged file is still staged, and is thrown away with the stream.
+		_stream.reset();
+		if (attempt >= DOWNLOAD_VERIFY_ATTEMPTS) {
+			throw std::runtime_error("Downloaded theme does not match its hash.");
+		}
+
+		std::error_code ec;
+		std::filesystem::remove(_path, ec);
 	}
+}
 
-	{ // Set up output file.
-		stream = std::ofstream(_path, std::ios::binary | std::ios::trunc | std::ios::out);
-		if (stream.bad()) {
-			state = download_state::FAILED;
-			emit download_status(uint64_t(0), uint64_t(0), static_cast<int64_t>(state));
-			throw std::runtime_error("");
+static void find_references(nlohmann::json const& value, std::set<std::string>& files)
+{
+	if (value.is_string()) {
+		own3d::util::asset_loader::find_references(value.get_ref<std::string const&>(), TOKEN_PATH, files);
+	} else if (value.is_structured()) {
+		for (auto const& child : value) {
+			find_references(child, files);
 		}
 	}
+}
 
-	{ // Begin curl work.
-		curl.set_option(CURLOPT_HTTPGET, true);
-		curl.set_option(CURLOPT_URL, _url);
-		curl.set_write_callback([this, &stream](void* buf, size_t n, size_t c) {
-			stream.write(reinterpret_cast<char*>(buf), n * c);
-			return n * c;
-		});
-		curl.set_xferinfo_callback([this, &state](uint64_t total, uint64_t now, uint64_t, uint64_t) {
-			if (state == download_state::UNKNOWN) {
-				state = download_state::CONNECTING;
-			} else if ((state == download_state::CONNECTING) && ((total != 0) || (now != 0))) {
-				state = download_state::DOWNLOADING;
-			}
-			emit download_status(static_cast<uint64_t>(now), static_cast<uint64_t>(total), static_cast<int64_t>(state));
-			return int32_t(0);
-		});
-		CURLcode res = curl.perform();
-		if (res != CURLE_OK) {
-			state = download_state::FAILED;
-			emit download_status(uint64_t(0), uint64_t(0), static_cast<int64_t>(state));
-			throw std::runtime_error("");
+bool own3d::ui::installer_thread::run_extract_lazy()
+{
+	auto loader = util::asset_loader::instance();
+	if (!loader)
+		return false;
+
+	util::zip                archive{_path, _out_path};
+	std::vector<std::string> names(archive.get_file_count());
+	for (uint64_t idx = 0; idx < names.size(); idx++) {
+		names[idx] = archive.get_file_name(idx);
+	}
+	auto data = std::find(names.begin(), names.end(), "data.json");
+	if (data == names.end())
+		return false;
+	archive.extract({static_cast<uint64_t>(data - names.begin())}, 1, [](uint64_t, uint64_t, uint64_t, uint64_t) {});
+
+	std::set<std::string> references;
+	try {
+		std::ifstream stream{std::filesystem::path(_out_path).append("data.json"), std::ios::binary | std::ios::in};
+		find_references(nlohmann::json::parse(stream), references);
+	} catch (std::exception const& ex) {
+		DLOG_WARNING("Failed to find the files Theme '%s' uses: %s", _name.c_str(), ex.what());
+		return false;
+	}
+
+	std::vector<uint64_t> indices;
+	std::set<std::string> pending;
+	for (uint64_t idx = 0; idx < names.size(); idx++) {
+		auto const& name = names[idx];
+		if ((name.length() > 0) && (name.back() == '/')) {
+			indices.push_back(idx);
+		} else if ((name == *data) || util::asset_loader::is_referenced(name, references)) {
+			indices.push_back(idx);
+		} else {
+			pending.insert(name);
 		}
 	}
 
-	// Manually close the stream.
-	stream.close();
+	archive.extract(indices, 0, [this](uint64_t now_files, uint64_t total_files, uint64_t now_bytes,
+									   uint64_t total_bytes) {
+		report_extract(now_files, total_files, now_bytes, total_bytes);
+	});
+	loader->add(_path, _out_path, pending);
+	DLOG_INFO("Extracted %zu of %zu files of Theme '%s', the rest follows once it is needed.", indices.size(),
+			  names.size(), _name.c_str());
+	return true;
+}
 
-	{ // Emit that we are done.
-		state = download_state::DONE;
-		emit download_status(uint64_t(0), uint64_t(0), static_cast<int64_t>(state));
+void own3d::ui::installer_thread::report_extract(uint64_t now_files, uint64_t total_files, uint64_t now_bytes,
+												  uint64_t total_bytes)
+{
+	// Files are extracted in parallel, so the bytes are the only measure that progresses evenly.
+	if (total_bytes > 0) {
+		_progress->update(now_bytes, total_bytes);
+	} else {
+		_progress->update(now_files, total_files, false);
 	}
 }
 
 void own3d::ui::installer_thread::run_extract()
 {
-	util::zip archive{_path, _out_path};
-	for (uint64_t idx = 0, edx = archive.get_file_count(); idx < edx; idx++) {
-#ifdef _DEBUG
-		DLOG_DEBUG("Extracting file %llu of %llu from Theme '%s'...", (idx + 1), edx, _name.c_str());
-#endif
-		archive.extract_file(idx, [this, &idx, &edx](uint64_t t, uint64_t n) {
-#ifdef _DEBUG
-			DLOG_DEBUG("  %llu of %llu bytes extracted...", n, t);
-#endif
-			emit extract_status(idx, edx, n, t);
+	_progress->begin(installer_progress::phase::EXTRACT);
+
+	if (_lazy && run_extract_lazy())
+		return;
+
+	// Everything is about to be extracted, so nothing is left for later.
+	if (auto loader = util::asset_loader::instance(); loader) {
+		loader->remove(_out_path);
+	}
+
+	if (_stream) {
+		// Most of the archive was extracted during the download already, so only wait for the rest.
+		bool complete = _stream->wait([this](uint64_t now_files, uint64_t total_files, uint64_t now_bytes,
+											 uint64_t total_bytes) {
+			report_extract(now_files, total_files, now_bytes, total_bytes);
 		});
+		// The download was verified already, so the staged files may replace the installed ones now.
+		if (complete && (_stream->files() == util::zip{_path, _out_path}.get_file_count())) {
+			_stream->commit();
+			_stream.reset();
+			return;
+		}
+		_stream.reset();
+		DLOG_INFO("Theme '%s' could not be extracted during the download, extracting it now.", _name.c_str());
 	}
+
+	util::zip archive{_path, _out_path};
+	archive.extract_all(0, [this](uint64_t now_files, uint64_t total_files, uint64_t now_bytes, uint64_t total_bytes) {
+		report_extract(now_files, total_files, now_bytes, total_bytes);
+	});
 }
 
-static void replace_tokens(obs_data_t* data, std::string base_directory_path)
+static void replace_tokens(obs_data_t* data, std::string base_directory_path, std::string const& machine_token)
 {
-	constexpr std::string_view TOKEN_PATH = "<REPLACE|ME>";
-	constexpr std::string_view TOKEN_UUID = "<machine-token>";
-
-	std::string_view machine_token = own3d::get_unique_identifier();
 	for (obs_data_item_t* item = obs_data_first(data); item != nullptr; obs_data_item_next(&item)) {
 		switch (obs_data_item_gettype(item)) {
 		case obs_data_type::OBS_DATA_STRING: {
@@ -143,35 +366,38 @@ static void replace_tokens(obs_data_t* data, std::string base_directory_path)
 		}
 		case obs_data_type::OBS_DATA_OBJECT: {
 			obs_data_t* chld = obs_data_item_get_obj(item);
-			replace_tokens(chld, base_directory_path);
+			replace_tokens(chld, base_directory_path, machine_token);
 		}
 		}
 	}
 }
 
-static void adjust_collection_entry(std::shared_ptr<obs_data_t> data, std::string base_path)
+static void adjust_collection_entry(std::shared_ptr<obs_data_t> data, std::string base_path,
+									std::string const& machine_token)
 {
 	auto settings = std::shared_ptr<obs_data_t>(obs_data_get_obj(data.get(), "settings"), own3d::data_deleter);
 	if (!settings)
 		return;
 
-	replace_tokens(settings.get(), base_path);
+	replace_tokens(settings.get(), base_path, machine_token);
 }
 
-static void adjust_collection_entries(std::shared_ptr<obs_data_array_t> data, std::string base_path)
+static void adjust_collection_entries(std::shared_ptr<obs_data_array_t> data, std::string base_path,
+									  std::string const& machine_token)
 {
 	for (size_t idx = 0, edx = obs_data_array_count(data.get()); idx < edx; idx++) {
 		auto obj = std::shared_ptr<obs_data_t>(obs_data_array_item(data.get(), idx), own3d::data_deleter);
-		adjust_collection_entry(obj, base_path);
+		adjust_collection_entry(obj, base_path, machine_token);
 
 		auto filters =
 			std::shared_ptr<obs_data_array_t>(obs_data_get_array(obj.get(), "filters"), own3d::data_array_deleter);
 		if (filters)
-			adjust_collection_entries(filters, base_path);
+			adjust_collection_entries(filters, base_path, machine_token);
 	}
 }
 
-static void adjust_collection(std::shared_ptr<obs_data_t> data, std::string name, std::string base_path)
+static void adjust_collection(std::shared_ptr<obs_data_t> data, std::string name, std::string base_path,
+							  std::string const& machine_token)
 {
 	// Need to adjust:
 	// data.transitions
@@ -187,11 +413,11 @@ static void adjust_collection(std::shared_ptr<obs_data_t> data, std::string name
 		std::shared_ptr<obs_data_array_t>(obs_data_get_array(data.get(), "transitions"), own3d::data_array_deleter);
 
 	if (groups)
-		adjust_collection_entries(groups, base_path);
+		adjust_collection_entries(groups, base_path, machine_token);
 	if (sources)
-		adjust_collection_entries(sources, base_path);
+		adjust_collection_entries(sources, base_path, machine_token);
 	if (transitions)
-		adjust_collection_entries(transitions, base_path);
+		adjust_collection_entries(transitions, base_path, machine_token);
 
 	// Update name.
 	obs_data_set_string(data.get(), "name", name.c_str());
@@ -242,7 +468,7 @@ void own3d::ui::installer_thread::run_install()
         std::filesystem::path(_out_path).append("..").append("..").append("..").append("..").append("basic").append(
             "scenes"));
 
-	emit install_status(false);
+	_progress->begin(installer_progress::phase::INSTALL);
 
 	// While there is no direct way to trigger a refresh of the scene collections,
 	// we can actually do this by switching scene collection. So to make things work:
@@ -317,7 +543,13 @@ void own3d::ui::installer_thread::run_install()
 			throw std::runtime_error("Failed to install theme, data.json may be corrupted.");
 		}
 
-		adjust_collection(data, name, std::filesystem::absolute(_out_path).u8string());
+		// Sources of the theme may need the machine token, which may still be on its way.
+		std::string machine_token;
+		if (std::string_view(obs_data_get_json(data.get())).find(TOKEN_UUID) != std::string_view::npos) {
+			machine_token = wait_for_unique_identifier();
+		}
+
+		adjust_collection(data, name, std::filesystem::absolute(_out_path).u8string(), machine_token);
 	}
 
 	// Step 3: Store current scene collection, and create new temporary one.
@@ -325,7 +557,7 @@ void own3d::ui::installer_thread::run_install()
 	obs_frontend_add_scene_collection(name.c_str());
 	emit switch_collection(QString::fromStdString(cur));
 	for (; strcmp(obs_frontend_get_current_scene_collection(), cur.c_str()) != 0;) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		pause_for(std::chrono::milliseconds(100));
 	}
 
 	// Step 4: Save JSON as new file.
@@ -336,10 +568,10 @@ void own3d::ui::installer_thread::run_install()
 	// Step 5: Switch to the new scene collection.
 	emit switch_collection(QString::fromStdString(name));
 	for (; strcmp(obs_frontend_get_current_scene_collection(), name.c_str()) != 0;) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		pause_for(std::chrono::milliseconds(100));
 	}
 
-	emit install_status(true);
+	_progress->begin(installer_progress::phase::DONE);
 	obs_frontend_save();
 }
 
@@ -347,19 +579,35 @@ void own3d::ui::installer_thread::run()
 try {
 	run_download();
 	run_extract();
+	if (auto store = util::blob_store::instance(); store) {
+		// Files replaced by this install may have been the last use of some stored files.
+		store->collect_garbage();
+	}
 	run_install();
 } catch (std::exception const& ex) {
+	_stream.reset();
+	_progress->begin(installer_progress::phase::FAILED);
 	DLOG_ERROR("Installation of Theme '%s' failed due to error: %s", _name.c_str(), ex.what());
 	emit error();
 } catch (...) {
+	_stream.reset();
+	_progress->begin(installer_progress::phase::FAILED);
 	emit error();
 }
 
-own3d::ui::installer::~installer() {}
+own3d::ui::installer::~installer()
+{
+	// Don't leave the worker running without us, and don't make the caller wait out a retry delay.
+	if (_worker) {
+		_worker->abort();
+		_worker->wait();
+	}
+}
 
 own3d::ui::installer::installer(const QUrl& url, const QString& name, const QString& hash)
-	: QDialog(reinterpret_cast<QWidget*>(obs_frontend_get_main_window())), Ui::ThemeDownload(), _download_url(url),
-	  _theme_name(name), _download_hash(hash)
+	: QDialog(reinterpret_cast<QWidget*>(obs_frontend_get_main_window())), Ui::ThemeDownload(), _worker(nullptr),
+	  _download_url(url), _theme_name(name), _download_hash(hash), _progress(std::make_shared<installer_progress>()),
+	  _progress_timer(nullptr), _progress_phase(installer_progress::phase::WAITING)
 {
 	// Check if we are in test mode or now.
 	if (!own3d::testing_enabled()) {
@@ -400,84 +648,104 @@ own3d::ui::installer::installer(const QUrl& url, const QString& name, const QStr
 	}
 
 	// Spawn a worker thread and begin work.
-	_worker = new installer_thread(url.toString().toStdString(), _theme_name.toStdString(), _theme_archive_path,
-								   _theme_path, this);
-	connect(_worker, &own3d::ui::installer_thread::download_status, this, &own3d::ui::installer::handle_download_status,
-			Qt::QueuedConnection);
-	connect(_worker, &own3d::ui::installer_thread::extract_status, this, &own3d::ui::installer::handle_extract_status,
-			Qt::QueuedConnection);
-	connect(_worker, &own3d::ui::installer_thread::install_status, this, &own3d::ui::installer::handle_install_status,
-			Qt::QueuedConnection);
+	_worker = new installer_thread(url.toString().toStdString(), _theme_name.toStdString(), hash.toStdString(),
+								   _theme_archive_path, _theme_path, _progress, this);
 	connect(_worker, &own3d::ui::installer_thread::switch_collection, this,
 			&own3d::ui::installer::handle_switch_collection, Qt::QueuedConnection);
+	update_progress(_progress->sample());
+
+	// The workers only update counters, which are shown at a fixed rate no matter how often they change.
+	_progress_timer = new QTimer(this);
+	connect(_progress_timer, &QTimer::timeout, this, &own3d::ui::installer::on_progress_timer);
+	_progress_timer->start(PROGRESS_INTERVAL_MS);
+
 	_worker->start();
 }
 
-void own3d::ui::installer::update_progress(double_t percent, bool is_download, bool is_extract, bool is_install)
+static std::string format_bytes(double_t bytes)
+{
+	constexpr std::string_view units[] = {"B", "KiB", "MiB", "GiB"};
+	size_t                     unit    = 0;
+	for (; (bytes >= 1024.) && ((unit + 1) < (sizeof(units) / sizeof(units[0]))); unit++) {
+		bytes /= 1024.;
+	}
+
+	std::vector<char> buffer(32);
+	snprintf(buffer.data(), buffer.size(), (unit == 0) ? "%.0f %s" : "%.1f %s", bytes, units[unit].data());
+	return std::string{buffer.data()};
+}
+
+static std::string format_duration(double_t seconds)
+{
+	auto              value = static_cast<uint64_t>(std::ceil(seconds));
+	std::vector<char> buffer(32);
+	if (value >= 3600) {
+		snprintf(buffer.data(), buffer.size(), "%llu:%02llu:%02llu", static_cast<unsigned long long>(value / 3600),
+				 static_cast<unsigned long long>((value / 60) % 60), static_cast<unsigned long long>(value % 60));
+	} else {
+		snprintf(buffer.data(), buffer.size(), "%llu:%02llu", static_cast<unsigned long long>(value / 60),
+				 static_cast<unsigned long long>(value % 60));
+	}
+	return std::string{buffer.data()};
+}
+
+void own3d::ui::installer::update_progress(installer_progress::snapshot const& value)
 {
-	if (is_download) {
+	switch (value.stage) {
+	case installer_progress::phase::DOWNLOAD:
 		status->setText(QString::fromStdString(std::string(D_TRANSLATE(I18N_STATE_DOWNLOAD.data()))));
-		percent /= 3.;
-	} else if (is_extract) {
+		break;
+	case installer_progress::phase::EXTRACT:
 		status->setText(QString::fromStdString(std::string(D_TRANSLATE(I18N_STATE_EXTRACT.data()))));
-		percent /= 3.;
-		percent += (1. / 3.);
-	} else if (is_install) {
+		break;
+	case installer_progress::phase::INSTALL:
+	case installer_progress::phase::DONE:
 		status->setText(QString::fromStdString(std::string(D_TRANSLATE(I18N_STATE_INSTALL.data()))));
-		percent /= 3.;
-		percent += (2. / 3.);
-	} else {
+		break;
+	case installer_progress::phase::WAITING:
+	case installer_progress::phase::FAILED:
 		status->setText(QString::fromStdString(std::string(D_TRANSLATE(I18N_STATE_WAITING.data()))));
-		percent = NAN;
+		break;
 	}
 
-	if (isnan(percent)) {
+	if (std::isnan(value.percent)) {
 		progressBar->setRange(0, 0);
 		progressBar->setValue(0);
 		progressBar->setTextVisible(false);
 	} else {
-		uint32_t val = static_cast<uint32_t>(percent * static_cast<double_t>((std::numeric_limits<uint32_t>::max)()));
+		uint32_t val =
+			static_cast<uint32_t>(value.percent * static_cast<double_t>((std::numeric_limits<uint32_t>::max)()));
 		progressBar->setRange((std::numeric_limits<int>::min)(), (std::numeric_limits<int>::max)());
 		progressBar->setValue(static_cast<int32_t>(static_cast<int64_t>((std::numeric_limits<int32_t>::min)()) + val));
 		progressBar->setTextVisible(true);
-	}
-}
 
-void own3d::ui::installer::handle_download_status(uint64_t now_bytes, uint64_t total_bytes, int64_t state)
-{
-	switch (static_cast<own3d::ui::download_state>(state)) {
-	case download_state::UNKNOWN:
-	case download_state::CONNECTING:
-		DLOG_DEBUG("Starting download of Theme '%s'...", _theme_name.toStdString().c_str());
-		update_progress(0, false, false, false);
-		break;
-	case download_state::DOWNLOADING:
-		DLOG_DEBUG("Download of Theme '%s' at %llu/%llu...", _theme_name.toStdString().c_str(), now_bytes, total_bytes);
-		update_progress(static_cast<double_t>(now_bytes) / static_cast<double_t>(total_bytes), true, false, false);
-		break;
-	case download_state::DONE:
-		DLOG_DEBUG("Download of Theme '%s' complete.", _theme_name.toStdString().c_str());
-		update_progress(1.0, true, false, false);
-		break;
-	case download_state::FAILED:
-		DLOG_DEBUG("Download of Theme '%s' failed.", _theme_name.toStdString().c_str());
-		update_progress(NAN, true, false, false);
-		emit error();
-		break;
+		if (!std::isnan(value.throughput) && !std::isnan(value.eta)) {
+			std::vector<char> buffer(256);
+			snprintf(buffer.data(), buffer.size(), D_TRANSLATE(I18N_REMAINING.data()),
+					 format_bytes(value.throughput).c_str(), format_duration(value.eta).c_str());
+			progressBar->setFormat(QString::fromStdString("%p% (" + std::string{buffer.data()} + ")"));
+		} else {
+			progressBar->setFormat(QString("%p%"));
+		}
 	}
 }
 
-void own3d::ui::installer::handle_extract_status(uint64_t now_files, uint64_t total_files, uint64_t now_bytes,
-												 uint64_t total_bytes)
+void own3d::ui::installer::on_progress_timer()
 {
-	double_t progress  = static_cast<double_t>(now_bytes) / static_cast<double_t>(total_bytes);
-	double_t progress2 = (static_cast<double_t>(now_files) + progress) / static_cast<double_t>(total_files);
-	update_progress(progress2, false, true, false);
-}
+	auto value = _progress->sample();
+	if (value.stage != _progress_phase) {
+		DLOG_DEBUG("Installation of Theme '%s' entered phase %" PRId32 ".", _theme_name.toStdString().c_str(),
+				   static_cast<int32_t>(value.stage));
+		_progress_phase = value.stage;
+	}
+	update_progress(value);
 
-void own3d::ui::installer::handle_install_status(bool complete)
-{
-	update_progress(complete ? 1.0 : 0.0, false, false, true);
+	if (value.stage == installer_progress::phase::DONE) {
+		_progress_timer->stop();
+	} else if (value.stage == installer_progress::phase::FAILED) {
+		_progress_timer->stop();
+		emit error();
+	}
 }
 
 void own3d::ui::installer::handle_switch_collection(QString new_collection)
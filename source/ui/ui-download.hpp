@@ -16,41 +16,129 @@
 
 #pragma once
 #include <QThread>
+#include <QTimer>
 #include <QUrl>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <obs-frontend-api.h>
 #include "ui_theme-download.h"
-#include "util/curl.hpp"
+#include "util/download.hpp"
+#include "util/zip-stream.hpp"
 #include "util/zip.hpp"
 
 namespace own3d::ui {
-	enum class download_state : int64_t {
-		UNKNOWN,
-		CONNECTING,
-		DOWNLOADING,
-		DONE,
-		FAILED,
+	/** Progress of an installation, updated by the workers and sampled by the UI at its own pace.
+	 *
+	 * Workers only store counters under a lock that is hardly ever contended, so reporting progress
+	 * costs them next to nothing no matter how often they do it. All phases are weighted into a
+	 * single percentage, from which the time left is estimated.
+	 */
+	class installer_progress {
+		public:
+		enum class phase : int32_t {
+			WAITING,
+			DOWNLOAD,
+			EXTRACT,
+			INSTALL,
+			DONE,
+			FAILED,
+		};
+
+		struct snapshot {
+			phase    stage;
+			double_t percent;    // Of the whole installation, NAN if unknown.
+			double_t throughput; // Bytes per second in the current phase, NAN if unknown.
+			double_t eta;        // Seconds until the installation is done, NAN if unknown.
+		};
+
+		private:
+		// Phase and counters change together, so that a sample never mixes one phase with another's counters.
+		std::mutex _lock;
+		phase      _phase;
+		uint64_t   _now;
+		uint64_t   _total;
+		bool       _bytes;
+
+		// Only used by the thread that samples.
+		phase                                 _last_phase;
+		uint64_t                              _last_now;
+		double_t                              _last_percent;
+		std::chrono::steady_clock::time_point _last_time;
+		double_t                              _throughput;
+		double_t                              _rate; // Of the percentage, per second.
+
+		public:
+		installer_progress();
+
+		/** Enter a phase, which starts its counters over. */
+		void begin(phase value);
+
+		/** @param bytes Whether the counters are bytes, or something else such as files. */
+		void update(uint64_t now, uint64_t total, bool bytes = true);
+
+		snapshot sample();
 	};
 
 	class installer_thread : public QThread {
 		Q_OBJECT;
 
-		std::string           _url;
 		std::string           _name;
 		std::filesystem::path _path;
 		std::filesystem::path _out_path;
 
+		// Fetches and verifies the theme pack.
+		util::download _download;
+
+		// Extracts the archive while it is being downloaded.
+		std::unique_ptr<util::zip_stream> _stream;
+
+		// Only extract the files the scene collection refers to, and leave the rest until they are needed.
+		bool _lazy;
+
+		std::shared_ptr<installer_progress> _progress;
+
+		// Set once the installation should stop, which also interrupts waiting for a retry.
+		std::mutex              _abort_lock;
+		std::condition_variable _abort_cv;
+		std::atomic<bool>       _abort;
+
 		public:
 		~installer_thread();
-		installer_thread(std::string url, std::string name, std::filesystem::path path, std::filesystem::path out_path,
+		installer_thread(std::string url, std::string name, std::string hash, std::filesystem::path path,
+						 std::filesystem::path out_path, std::shared_ptr<installer_progress> progress,
 						 QObject* parent = nullptr);
 
+		/** Stop the installation as soon as possible, for example because the dialog is going away. */
+		void abort();
+
 		private:
+		/** Wait for the delay to pass, or throw if the installation is aborted in the meantime. */
+		void pause_for(std::chrono::milliseconds delay);
+
+		/** Wait for the machine token, which is requested in the background if there is none yet.
+		 *
+		 * Throws if it doesn't arrive in time, or if the installation is aborted in the meantime.
+		 */
+		std::string wait_for_unique_identifier();
+
 		void run_download();
 
+		/** Report the progress of an extraction, which may only know the number of files. */
+		void report_extract(uint64_t now_files, uint64_t total_files, uint64_t now_bytes, uint64_t total_bytes);
+
 		void run_extract();
 
+		/** Extract only data.json and the files it refers to.
+		 * @return false if the theme needs to be extracted completely instead.
+		 */
+		bool run_extract_lazy();
+
 		void run_install();
 
 		public:
@@ -59,12 +147,6 @@ namespace own3d::ui {
 		signals:
 		; // Needed by some linters.
 
-		void download_status(uint64_t now_bytes, uint64_t total_bytes, int64_t state);
-
-		void extract_status(uint64_t now_files, uint64_t total_files, uint64_t now_bytes, uint64_t total_bytes);
-
-		void install_status(bool complete);
-
 		void error();
 
 		void switch_collection(QString new_collection);
@@ -83,21 +165,21 @@ namespace own3d::ui {
 
 		util::zip* _extractor;
 
+		std::shared_ptr<installer_progress> _progress;
+		QTimer*                             _progress_timer;
+		installer_progress::phase           _progress_phase;
+
 		public:
 		~installer();
 		installer(const QUrl& url, const QString& name, const QString& hash);
 
 		private:
-		void update_progress(double_t percent, bool is_download, bool is_extract, bool is_install);
+		void update_progress(installer_progress::snapshot const& value);
 
 		private slots:
 		; // Needed by some linters.
 
-		void handle_download_status(uint64_t now_bytes, uint64_t total_bytes, int64_t state);
-
-		void handle_extract_status(uint64_t now_files, uint64_t total_files, uint64_t now_bytes, uint64_t total_bytes);
-
-		void handle_install_status(bool complete);
+		void on_progress_timer();
 
 		void handle_switch_collection(QString new_collection);
 
@@ -20,19 +20,23 @@
 
 #include "ui-updater.hpp"
 #include "plugin.hpp"
-#include "util/curl.hpp"
+#include "util/api.hpp"
+#include "util/http-engine.hpp"
 #include "version.hpp"
 
 #include <QDesktopServices>
 #include <QMainWindow>
 #include <QUrl>
-#include <nlohmann/json.hpp>
-#include <sstream>
 
 #include <obs-frontend-api.h>
 
 static constexpr std::string_view UPDATE_URL = "https://own3d.pro/download-plugin";
 
+// Retry transient failures for up to two minutes, waiting up to 30 seconds between attempts.
+static constexpr auto UPDATER_RETRY_INITIAL = std::chrono::seconds(1);
+static constexpr auto UPDATER_RETRY_MAXIMUM = std::chrono::seconds(30);
+static constexpr auto UPDATER_RETRY_ELAPSED = std::chrono::minutes(2);
+
 own3d::ui::version_info::version_info(std::string_view version)
 {
 	// version can be:
@@ -155,7 +159,8 @@ bool own3d::ui::version_info::is_newer(version_info& other)
 	return true;
 }
 
-own3d::ui::updater::updater(QWidget* parent) : QDialog(parent), Ui::Updater(), _lock(), _is_checking(false), _task()
+own3d::ui::updater::updater(QWidget* parent)
+	: QDialog(parent), Ui::Updater(), _lock(), _is_checking(false), _request(), _retry()
 {
 	// Set up UI elements.
 	setupUi(this);
@@ -173,96 +178,63 @@ own3d::ui::updater::updater(QWidget* parent) : QDialog(parent), Ui::Updater(), _
 
 own3d::ui::updater::~updater()
 {
-	// Forcefully rejoin with the thread if any is active.
-	if (_task.joinable())
-		_task.join();
+	// Make sure that no response arrives after we are gone.
+	if (auto engine = own3d::util::http_engine::instance(); engine && _request)
+		engine->cancel(_request);
 }
 
 void own3d::ui::updater::check()
 {
-	std::unique_lock<std::mutex> lock(_lock);
-	if (_is_checking) {
-		return;
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		if (_is_checking) {
+			return;
+		}
+		_is_checking = true;
 	}
 
-	// Forcefully rejoin with the thread if any is active.
-	if (_task.joinable())
-		_task.join();
-
-	// Spawn a new task to check for updates.
-	_is_checking = true;
-	_task        = std::thread{std::bind(&own3d::ui::updater::check_main, this)};
+	// Queue a new request to check for updates.
+	_retry =
+		std::make_shared<own3d::util::backoff>(UPDATER_RETRY_INITIAL, UPDATER_RETRY_MAXIMUM, UPDATER_RETRY_ELAPSED);
+	check_main();
 }
 
 void own3d::ui::updater::check_main()
 {
 	try {
-		own3d::util::curl curl;
-		std::stringstream stream;
-		version_info      current;
-
-		// Request update information from the remote.
-		curl.set_option(CURLOPT_HTTPGET, true);
-		curl.set_option(CURLOPT_POST, false);
-		curl.set_option(CURLOPT_URL, own3d::get_api_endpoint("obs/releases"));
-		curl.set_option(CURLOPT_TIMEOUT, 10);
-		curl.set_write_callback([this, &stream](void* buf, size_t n, size_t c) {
-			stream.write(reinterpret_cast<char*>(buf), n * c);
-			return n * c;
-		});
-		CURLcode res = curl.perform();
-
-		// Parse returned information.
-		if (res == CURLE_OK) {
-			long response_code;
-			curl.get_info(CURLINFO_RESPONSE_CODE, response_code);
-
-			if (response_code != 200) {
-				throw std::runtime_error(
-					QString::fromUtf8("Server responded with code %1d.").arg(response_code).toStdString());
-				return;
-			}
+		// This is called from the UI thread, which must never wait for a transfer.
+		_request = own3d::util::request_releases(own3d::get_api_endpoint("obs/releases"), _retry,
+												 std::bind(&own3d::ui::updater::check_response, this,
+														   std::placeholders::_1, std::placeholders::_2));
+	} catch (std::exception const& ex) {
+		emit error(QString::fromUtf8(ex.what()));
+		emit check_completed();
+	} catch (...) {
+		emit error(QString::fromUtf8("An unknown error occurred."));
+		emit check_completed();
+	}
+}
 
-			nlohmann::json data;
-			try {
-				data = nlohmann::json::parse(stream.str());
-			} catch (std::exception const& ex) {
-				throw ex;
-			}
+void own3d::ui::updater::check_response(std::vector<own3d::util::release> releases, std::string message)
+{
+	try {
+		version_info current;
 
-			if (!data.is_array()) {
-				throw std::runtime_error("JSON response is malformed.");
-			}
+		if (message.length() > 0) {
+			throw std::runtime_error(message);
+		}
 
-			// Iterate over all array entries.
-			for (auto entry : data) {
-				auto prerelease = entry.find("prerelease");
-				if (prerelease == entry.end()) {
-					throw std::runtime_error("JSON response is malformed.");
-				}
-
-				auto tag_name = entry.find("tag_name");
-				if (tag_name == entry.end()) {
-					throw std::runtime_error("JSON response is malformed.");
-				}
-
-				// Ignore Testing channel.
-				if (prerelease->get<bool>() == true) {
-					continue;
-				}
-
-				// Compare the update version.
-				version_info update(tag_name->get<std::string>());
-				if (update.is_newer(current)) {
-					emit update_available(update);
-				}
+		for (auto const& release : releases) {
+			// Ignore Testing channel.
+			if (release.prerelease) {
+				continue;
 			}
 
-		} else {
-			std::string str = QString::fromUtf8("Failed to query server for updates: %1s")
-								  .arg(QString::fromUtf8(curl_easy_strerror(res)))
-								  .toStdString();
-			throw std::runtime_error(str);
+			// Compare the update version.
+			version_info update(release.tag_name);
+			if (update.is_newer(current)) {
+				emit update_available(update);
+			}
 		}
 
 		emit check_completed();
@@ -19,9 +19,12 @@
 // SOFTWARE.
 
 #pragma once
+#include <memory>
 #include <mutex>
+#include <string>
 #include <string_view>
-#include <thread>
+#include <vector>
+#include "util/api.hpp"
 
 #include "ui_updater.h"
 
@@ -47,9 +50,10 @@ namespace own3d::ui {
 	class updater : public QDialog, protected Ui::Updater {
 		Q_OBJECT
 
-		std::mutex  _lock;
-		bool        _is_checking;
-		std::thread _task;
+		std::mutex                            _lock;
+		bool                                  _is_checking;
+		std::shared_ptr<own3d::util::curl>    _request;
+		std::shared_ptr<own3d::util::backoff> _retry;
 
 		public:
 		updater(QWidget* parent);
@@ -60,6 +64,8 @@ namespace own3d::ui {
 		private:
 		void check_main();
 
+		void check_response(std::vector<own3d::util::release> releases, std::string message);
+
 		signals:
 		; // Needed by some linters.
 
@@ -20,15 +20,27 @@
 #include <QMenuBar>
 #include <QTranslator>
 #include "plugin.hpp"
+#include "util/asset-loader.hpp"
+#include "util/http-engine.hpp"
+#include "util/throttle.hpp"
 
 #include <obs-frontend-api.h>
 
 static constexpr std::string_view I18N_MENU                 = "Menu";
 static constexpr std::string_view I18N_THEMEBROWSER_MENU    = "Menu.ThemeBrowser";
 static constexpr std::string_view I18N_MENU_CHECKFORUPDATES = "Menu.CheckForUpdates";
+static constexpr std::string_view I18N_MENU_EXTRACTTHEMES   = "Menu.ExtractThemes";
 static constexpr std::string_view I18N_MENU_ABOUT           = "Menu.About";
 
-static constexpr std::string_view CFG_PRIVACYPOLICY = "privacypolicy";
+static constexpr std::string_view CFG_PRIVACYPOLICY  = "privacypolicy";
+static constexpr std::string_view CFG_THROTTLE_SHARE = "throttle.share";
+
+// Background transfers may use this share (in percent) of the stream's bitrate while live.
+static constexpr int64_t DEFAULT_THROTTLE_SHARE = 25;
+// Never throttle below this many bytes per second, so that downloads still finish eventually.
+static constexpr uint64_t THROTTLE_MINIMUM = 64 * 1024;
+// How often the stream's bitrate is measured.
+static constexpr int THROTTLE_INTERVAL_MS = 1000;
 
 inline void qt_init_resource()
 {
@@ -73,7 +85,8 @@ own3d::ui::ui::~ui()
 
 own3d::ui::ui::ui()
 	: _translator(), _gdpr(), _privacypolicy(false), _menu(), _menu_action(), _theme_action(), _update_action(),
-	  _about_action(), _theme_browser(), _download(), _eventlist_dock(), _eventlist_dock_action()
+	  _extract_action(), _about_action(), _theme_browser(), _download(), _eventlist_dock(), _eventlist_dock_action(),
+	  _prewarm(), _throttle_timer(), _throttle_bytes(0), _throttle_time()
 {
 	qt_init_resource();
 	obs_frontend_add_event_callback(obs_event_handler, this);
@@ -84,6 +97,9 @@ own3d::ui::ui::ui()
 		// GDPR Flag
 		obs_data_set_default_bool(cfg->get().get(), CFG_PRIVACYPOLICY.data(), false);
 		_privacypolicy = obs_data_get_bool(cfg->get().get(), CFG_PRIVACYPOLICY.data());
+
+		// Bandwidth Throttling, 0 turns it off.
+		obs_data_set_default_int(cfg->get().get(), CFG_THROTTLE_SHARE.data(), DEFAULT_THROTTLE_SHARE);
 	}
 }
 
@@ -99,6 +115,12 @@ void own3d::ui::ui::obs_event_handler(obs_frontend_event event, void* private_da
 
 void own3d::ui::ui::load()
 {
+	// Get DNS, TCP and TLS out of the way before the user first needs the service.
+	if (auto engine = own3d::util::http_engine::instance(); engine) {
+		// The API, updater and theme browser all live on the configured endpoint's host.
+		_prewarm = engine->prewarm(own3d::get_web_endpoint());
+	}
+
 	// Add translator.
 	_translator = static_cast<QTranslator*>(new own3d_translator(this));
 	QCoreApplication::installTranslator(_translator);
@@ -128,6 +150,10 @@ void own3d::ui::ui::load()
 		_update_action = _menu->addAction(D_TRANSLATE(I18N_MENU_CHECKFORUPDATES.data()));
 		connect(_update_action, &QAction::triggered, this, &own3d::ui::ui::menu_update_triggered);
 
+		// Add full extraction of themes that were installed with only the files they use.
+		_extract_action = _menu->addAction(D_TRANSLATE(I18N_MENU_EXTRACTTHEMES.data()));
+		connect(_extract_action, &QAction::triggered, this, &own3d::ui::ui::menu_extract_triggered);
+
 		// Add About
 		_about_action = _menu->addAction(D_TRANSLATE(I18N_MENU_ABOUT.data()));
 		_about_action->setMenuRole(QAction::NoRole);
@@ -165,6 +191,12 @@ void own3d::ui::ui::load()
 		_chat_dock_action = _chat_dock->add_obs_dock();
 	}
 
+	{ // Bandwidth Throttling, which is always sampled so that changes to the share apply right away.
+		_throttle_timer = new QTimer(this);
+		connect(_throttle_timer, &QTimer::timeout, this, &own3d::ui::ui::on_throttle_timer);
+		_throttle_timer->start(THROTTLE_INTERVAL_MS);
+	}
+
 	// Verify that the user has accepted the privacy policy.
 	if (!_privacypolicy) {
 		_gdpr->show();
@@ -176,6 +208,22 @@ void own3d::ui::ui::load()
 
 void own3d::ui::ui::unload()
 {
+	if (_prewarm) { // Connection Pre-Warming
+		if (auto engine = own3d::util::http_engine::instance(); engine) {
+			engine->cancel(_prewarm);
+		}
+		_prewarm.reset();
+	}
+
+	if (_throttle_timer) { // Bandwidth Throttling
+		_throttle_timer->stop();
+		_throttle_timer->deleteLater();
+		_throttle_timer = nullptr;
+		if (auto throttle = own3d::util::throttle::instance(); throttle) {
+			throttle->set_limit(0);
+		}
+	}
+
 	{ // Chat Dock
 		_chat_dock->deleteLater();
 		_chat_dock = nullptr;
@@ -198,6 +246,7 @@ void own3d::ui::ui::unload()
 
 	if (_menu) { // OWN3D Menu
 		_update_action->deleteLater();
+		_extract_action->deleteLater();
 		_theme_action->deleteLater();
 		_menu_action->deleteLater();
 		_menu->deleteLater();
@@ -255,6 +304,12 @@ void own3d::ui::ui::menu_update_triggered(bool)
 		_updater->check();
 }
 
+void own3d::ui::ui::menu_extract_triggered(bool)
+{
+	if (auto loader = own3d::util::asset_loader::instance(); loader)
+		loader->extract_all();
+}
+
 void own3d::ui::ui::menu_about_triggered(bool)
 {
 	QDesktopServices::openUrl(QUrl(QString::fromUtf8("https://own3d.pro")));
@@ -287,3 +342,48 @@ void own3d::ui::ui::own3d_theme_selected(const QUrl& download_url, const QString
 	// FIXME! Don't recreate it, instead reset it.
 	_download = new own3d::ui::installer(download_url, name, hash);
 }
+
+void own3d::ui::ui::on_throttle_timer()
+{
+	auto throttle = own3d::util::throttle::instance();
+	if (!throttle)
+		return;
+
+	// Read the share every time, so that changing it takes effect without a restart.
+	int64_t share = 0;
+	if (auto cfg = own3d::configuration::instance(); cfg) {
+		share = std::max<int64_t>(obs_data_get_int(cfg->get().get(), CFG_THROTTLE_SHARE.data()), 0);
+	}
+
+	// Only streaming competes for the network, recordings go to disk.
+	obs_output_t* output =
+		((share > 0) && obs_frontend_streaming_active()) ? obs_frontend_get_streaming_output() : nullptr;
+	if (!output) {
+		if (throttle->get_limit() != 0) {
+			DLOG_INFO("Stream ended or throttling disabled, no longer limiting background transfers.");
+			throttle->set_limit(0);
+		}
+		_throttle_bytes = 0;
+		return;
+	}
+
+	auto     now   = std::chrono::steady_clock::now();
+	uint64_t bytes = obs_output_get_total_bytes(output);
+	obs_output_release(output);
+
+	// Measure the actual bitrate, which also accounts for audio and any dynamic bitrate adjustments.
+	uint64_t limit = THROTTLE_MINIMUM;
+	if ((_throttle_bytes > 0) && (bytes > _throttle_bytes)) {
+		double_t elapsed = std::chrono::duration<double_t>(now - _throttle_time).count();
+		double_t rate    = static_cast<double_t>(bytes - _throttle_bytes) / elapsed;
+		limit = std::max<uint64_t>(static_cast<uint64_t>(rate * share / 100.), THROTTLE_MINIMUM);
+	}
+	_throttle_bytes = bytes;
+	_throttle_time  = now;
+
+	if (throttle->get_limit() == 0) {
+		DLOG_INFO("Stream is live, limiting background transfers to %llu KiB/s.",
+				  static_cast<unsigned long long>(limit / 1024));
+	}
+	throttle->set_limit(limit);
+}
@@ -18,6 +18,8 @@
 #include <QAction>
 #include <QMenu>
 #include <QSharedPointer>
+#include <QTimer>
+#include <chrono>
 #include <memory>
 #include <obs-frontend-api.h>
 #include "ui-browser.hpp"
@@ -26,6 +28,7 @@
 #include "ui-download.hpp"
 #include "ui-gdpr.hpp"
 #include "ui-updater.hpp"
+#include "util/curl.hpp"
 
 namespace own3d::ui {
 	class ui : public QObject {
@@ -41,6 +44,7 @@ namespace own3d::ui {
 		QAction* _menu_action;
 		QAction* _theme_action;
 		QAction* _update_action;
+		QAction* _extract_action;
 		QAction* _about_action;
 
 		QSharedPointer<own3d::ui::updater> _updater;
@@ -55,6 +59,12 @@ namespace own3d::ui {
 		QSharedPointer<dock::chat> _chat_dock;
 		QAction*                   _chat_dock_action;
 
+		std::shared_ptr<own3d::util::curl> _prewarm;
+
+		QTimer*                               _throttle_timer;
+		uint64_t                              _throttle_bytes;
+		std::chrono::steady_clock::time_point _throttle_time;
+
 		public:
 		~ui();
 		ui();
@@ -76,10 +86,14 @@ namespace own3d::ui {
 
 		void menu_update_triggered(bool);
 
+		void menu_extract_triggered(bool);
+
 		void menu_about_triggered(bool);
 
 		void own3d_theme_selected(const QUrl& download_url, const QString& name, const QString& hash);
 
+		void on_throttle_timer();
+
 		private /* Singleton */:
 		static std::shared_ptr<own3d::ui::ui> _instance;
 
@@ -0,0 +1,173 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "api.hpp"
+#include <stdexcept>
+#include "curl-sink.hpp"
+#include "http-engine.hpp"
+#include "json/json.hpp"
+#include "plugin.hpp"
+
+// How long a single attempt at an API request may take.
+constexpr long API_TIMEOUT_MACHINE_TOKEN = 30L;
+constexpr long API_TIMEOUT_RELEASES      = 10L;
+
+static void schedule_machine_token(std::shared_ptr<own3d::util::curl> rq, std::shared_ptr<own3d::util::backoff> retry,
+								   own3d::util::machine_token_callback_t callback, std::chrono::milliseconds delay)
+{
+	auto engine = own3d::util::http_engine::instance();
+	if (!engine) {
+		callback("");
+		return;
+	}
+
+	// Every attempt starts with an empty response.
+	auto id = std::make_shared<own3d::util::buffer_sink>();
+	rq->set_sink(id);
+
+	engine->schedule(delay, rq, [rq, id, retry, callback](CURLcode res) {
+		long http_code = 0;
+		rq->get_info(CURLINFO_RESPONSE_CODE, http_code);
+
+		size_t attempt = retry->attempts() + 1;
+		if ((res == CURLE_OK) && (http_code == 200) && (id->size() > 0)) {
+			callback(std::string(id->view()));
+			return;
+		} else if (res == CURLE_ABORTED_BY_CALLBACK) { // Shutting down.
+			callback("");
+			return;
+		} else if (res != CURLE_OK) {
+			DLOG_WARNING("Attempt %zu at retrieving a unique machine id failed: %s", attempt, curl_easy_strerror(res));
+		} else if (http_code != 200) {
+			DLOG_WARNING("Attempt %zu at retrieving a unique machine id failed with HTTP status %ld.", attempt,
+						 http_code);
+		} else {
+			DLOG_WARNING("Attempt %zu at retrieving a unique machine id returned empty id.", attempt);
+		}
+
+		std::chrono::milliseconds next_delay;
+		if (((res == CURLE_OK) && (http_code == 200)) || own3d::util::is_retryable(res, http_code)) {
+			if (retry->next(next_delay)) {
+				schedule_machine_token(rq, retry, callback, next_delay);
+				return;
+			}
+		}
+
+		DLOG_ERROR("Failed to acquire unique machine id. Functionality disabled.");
+		callback("");
+	});
+}
+
+void own3d::util::request_machine_token(std::string url, std::string data, std::shared_ptr<backoff> retry,
+										machine_token_callback_t callback)
+{
+	auto rq = std::make_shared<util::curl>();
+	rq->set_option(CURLOPT_USERAGENT, OWN3D_USER_AGENT);
+	rq->set_option(CURLOPT_URL, url);
+	rq->set_option(CURLOPT_COPYPOSTFIELDS, data);
+	rq->set_option(CURLOPT_POST, true);
+	rq->set_option(CURLOPT_TIMEOUT, API_TIMEOUT_MACHINE_TOKEN);
+	rq->set_header("Content-Type", "application/json");
+
+	schedule_machine_token(rq, retry, callback, std::chrono::milliseconds(0));
+}
+
+static std::vector<own3d::util::release> parse_releases(std::string_view text)
+{
+	std::vector<own3d::util::release> releases;
+
+	auto data = nlohmann::json::parse(text.begin(), text.end());
+	if (!data.is_array()) {
+		throw std::runtime_error("JSON response is malformed.");
+	}
+
+	for (auto entry : data) {
+		auto prerelease = entry.find("prerelease");
+		auto tag_name   = entry.find("tag_name");
+		if ((prerelease == entry.end()) || (tag_name == entry.end())) {
+			throw std::runtime_error("JSON response is malformed.");
+		}
+
+		own3d::util::release value;
+		value.tag_name   = tag_name->get<std::string>();
+		value.prerelease = prerelease->get<bool>();
+		releases.push_back(value);
+	}
+	return releases;
+}
+
+static void on_releases(std::shared_ptr<own3d::util::curl> rq, std::shared_ptr<own3d::util::buffer_sink> response,
+						std::shared_ptr<own3d::util::backoff> retry, own3d::util::releases_callback_t callback,
+						CURLcode res)
+{
+	long response_code = 0;
+	rq->get_info(CURLINFO_RESPONSE_CODE, response_code);
+
+	{ // Try again later if this looks like a temporary problem.
+		std::chrono::milliseconds delay;
+		auto                      engine = own3d::util::http_engine::instance();
+		if (engine && retry && own3d::util::is_retryable(res, response_code) && retry->next(delay)) {
+			DLOG_WARNING("Checking for updates failed (%s, HTTP %ld), retrying in %lld ms.", curl_easy_strerror(res),
+						 response_code, static_cast<long long>(delay.count()));
+			response->clear();
+			engine->schedule(delay, rq, [rq, response, retry, callback](CURLcode res) {
+				on_releases(rq, response, retry, callback, res);
+			});
+			return;
+		}
+	}
+
+	std::vector<own3d::util::release> releases;
+	try {
+		if (res != CURLE_OK) {
+			throw std::runtime_error(std::string("Failed to query server for updates: ") + curl_easy_strerror(res));
+		} else if (response_code != 200) {
+			throw std::runtime_error("Server responded with code " + std::to_string(response_code) + ".");
+		}
+		releases = parse_releases(response->view());
+	} catch (std::exception const& ex) {
+		callback({}, ex.what());
+		return;
+	}
+	callback(releases, "");
+}
+
+std::shared_ptr<own3d::util::curl> own3d::util::request_releases(std::string url, std::shared_ptr<backoff> retry,
+																  releases_callback_t callback)
+{
+	auto engine = util::http_engine::instance();
+	if (!engine) {
+		throw std::runtime_error("Network is not available.");
+	}
+
+	auto rq       = std::make_shared<util::curl>();
+	auto response = std::make_shared<util::buffer_sink>();
+	rq->set_option(CURLOPT_HTTPGET, true);
+	rq->set_option(CURLOPT_POST, false);
+	rq->set_option(CURLOPT_URL, url);
+	rq->set_option(CURLOPT_TIMEOUT, API_TIMEOUT_RELEASES);
+	rq->set_sink(response);
+
+	// Only transfer the release list if it changed, and survive the server being unreachable.
+	rq->set_cache(true);
+
+	// This runs in the background, so stay out of the way of a live stream.
+	rq->set_throttle(true);
+
+	engine->submit(rq,
+				   [rq, response, retry, callback](CURLcode res) { on_releases(rq, response, retry, callback, res); });
+	return rq;
+}
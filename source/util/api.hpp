@@ -0,0 +1,53 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "curl.hpp"
+#include "retry.hpp"
+
+namespace own3d::util {
+	/** Called with the issued machine token, or an empty string if none could be acquired. */
+	typedef std::function<void(std::string token)> machine_token_callback_t;
+
+	/** Ask the API for a new machine token, in the background.
+	 *
+	 * Failures which may go away on their own are tried again after the delays of the back off.
+	 * @param data JSON describing this machine.
+	 */
+	void request_machine_token(std::string url, std::string data, std::shared_ptr<backoff> retry,
+							   machine_token_callback_t callback);
+
+	struct release {
+		std::string tag_name;
+		bool        prerelease = false;
+	};
+
+	/** Called with the published releases, or with a description of why they couldn't be retrieved. */
+	typedef std::function<void(std::vector<release> releases, std::string error)> releases_callback_t;
+
+	/** Ask the API for the published releases of the plugin, in the background.
+	 *
+	 * The list is cached, and the request gives way to a live stream. Failures which may go away on
+	 * their own are tried again after the delays of the back off.
+	 * @return The request, which is reused for every attempt and can be cancelled with the transfer engine.
+	 */
+	std::shared_ptr<curl> request_releases(std::string url, std::shared_ptr<backoff> retry,
+										   releases_callback_t callback);
+} // namespace own3d::util
@@ -0,0 +1,373 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "asset-loader.hpp"
+#include <algorithm>
+#include <fstream>
+#include "json/json.hpp"
+#include "plugin.hpp"
+#include "zip-index.hpp"
+#include "zip.hpp"
+
+// Name of the file in a theme that lists the entries which weren't extracted yet.
+constexpr std::string_view PENDING_NAME = ".own3d-pending.json";
+// Name under which the pack is kept in a theme, for as long as entries are missing.
+constexpr std::string_view ARCHIVE_NAME = ".own3d-theme.pack";
+
+static void collect_strings(obs_data_t* data, std::vector<std::string>& strings)
+{
+	for (obs_data_item_t* item = obs_data_first(data); item != nullptr; obs_data_item_next(&item)) {
+		switch (obs_data_item_gettype(item)) {
+		case obs_data_type::OBS_DATA_STRING:
+			if (const char* value = obs_data_item_get_string(item); value) {
+				strings.emplace_back(value);
+			}
+			break;
+		case obs_data_type::OBS_DATA_OBJECT: {
+			auto child = std::shared_ptr<obs_data_t>(obs_data_item_get_obj(item), own3d::data_deleter);
+			if (child)
+				collect_strings(child.get(), strings);
+			break;
+		}
+		case obs_data_type::OBS_DATA_ARRAY: {
+			auto array =
+				std::shared_ptr<obs_data_array_t>(obs_data_item_get_array(item), own3d::data_array_deleter);
+			for (size_t idx = 0, edx = obs_data_array_count(array.get()); idx < edx; idx++) {
+				auto child = std::shared_ptr<obs_data_t>(obs_data_array_item(array.get(), idx), own3d::data_deleter);
+				if (child)
+					collect_strings(child.get(), strings);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+own3d::util::asset_loader::~asset_loader()
+{
+	signal_handler_disconnect(obs_get_signal_handler(), "source_activate", on_source_activate, this);
+	signal_handler_disconnect(obs_get_signal_handler(), "source_show", on_source_activate, this);
+
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_shutdown = true;
+		_cv.notify_all();
+	}
+	if (_worker.joinable())
+		_worker.join();
+
+	for (auto& value : _jobs) {
+		obs_weak_source_release(value.source);
+	}
+}
+
+own3d::util::asset_loader::asset_loader() : _lock(), _cv(), _themes(), _jobs(), _shutdown(false), _worker()
+{
+	{ // Pick up themes that still have files missing from previous runs.
+		char* buf = obs_module_config_path("themes");
+		if (!buf) {
+			throw std::runtime_error("Plugin has no configuration directory, libobs broke.");
+		}
+		std::filesystem::path path = std::filesystem::u8path(buf);
+		bfree(buf);
+
+		std::error_code ec;
+		for (auto const& entry : std::filesystem::directory_iterator(path, ec)) {
+			if (entry.is_directory(ec)) {
+				load(entry.path());
+			}
+		}
+	}
+
+	_worker = std::thread(&own3d::util::asset_loader::run, this);
+
+	signal_handler_connect(obs_get_signal_handler(), "source_activate", on_source_activate, this);
+	signal_handler_connect(obs_get_signal_handler(), "source_show", on_source_activate, this);
+}
+
+void own3d::util::asset_loader::load(std::filesystem::path const& path)
+try {
+	std::ifstream stream{std::filesystem::path(path).append(PENDING_NAME), std::ios::binary | std::ios::in};
+	if (!stream.good())
+		return;
+
+	auto  data  = nlohmann::json::parse(stream);
+	theme value;
+	value.archive = std::filesystem::u8path(data.at("archive").get<std::string>());
+	value.base    = data.at("base").get<std::string>();
+	for (auto const& file : data.at("files")) {
+		value.pending.insert(file.get<std::string>());
+	}
+	if (!std::filesystem::exists(value.archive)) {
+		DLOG_WARNING("Pack of theme '%s' is gone, its missing files can't be extracted anymore.",
+					 path.u8string().c_str());
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(_lock);
+	_themes[path] = std::move(value);
+} catch (std::exception const& ex) {
+	DLOG_WARNING("Ignoring damaged list of missing files in theme '%s': %s", path.u8string().c_str(), ex.what());
+}
+
+void own3d::util::asset_loader::save(std::filesystem::path const& path, theme const& value)
+{
+	auto data       = nlohmann::json::object();
+	data["archive"] = value.archive.u8string();
+	data["base"]    = value.base;
+	data["files"]   = value.pending;
+
+	auto file      = std::filesystem::path(path).append(PENDING_NAME);
+	auto temporary = std::filesystem::path(file).concat(".tmp");
+	{
+		std::ofstream stream{temporary, std::ios::binary | std::ios::trunc | std::ios::out};
+		stream << data.dump();
+		if (!stream.good())
+			throw std::runtime_error("Failed to write list of missing files.");
+	}
+	std::filesystem::rename(temporary, file);
+}
+
+void own3d::util::asset_loader::run()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	while (!_shutdown) {
+		if (_jobs.empty()) {
+			_cv.wait(lock);
+			continue;
+		}
+
+		job value = std::move(_jobs.front());
+		_jobs.pop_front();
+		lock.unlock();
+		try {
+			process(value);
+		} catch (std::exception const& ex) {
+			DLOG_ERROR("Failed to extract files of theme '%s': %s", value.path.u8string().c_str(), ex.what());
+		}
+		obs_weak_source_release(value.source);
+		lock.lock();
+	}
+}
+
+void own3d::util::asset_loader::process(job& value)
+{
+	std::filesystem::path archive_path;
+	std::set<std::string> files;
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		auto                         itr = _themes.find(value.path);
+		if (itr == _themes.end())
+			return;
+
+		archive_path = itr->second.archive;
+		if (value.files.empty()) {
+			files = itr->second.pending;
+		} else {
+			std::set_intersection(value.files.begin(), value.files.end(), itr->second.pending.begin(),
+								  itr->second.pending.end(), std::inserter(files, files.begin()));
+		}
+	}
+
+	if (!files.empty()) {
+		{
+			util::zip             archive{archive_path, value.path};
+			std::vector<uint64_t> indices;
+			for (uint64_t idx = 0, edx = archive.get_file_count(); idx < edx; idx++) {
+				if (files.count(archive.get_file_name(idx)) > 0) {
+					indices.push_back(idx);
+				}
+			}
+			DLOG_INFO("Extracting %zu missing files of theme '%s'...", indices.size(),
+					  value.path.u8string().c_str());
+			archive.extract(indices, 0, [](uint64_t, uint64_t, uint64_t, uint64_t) {});
+		}
+
+		std::unique_ptr<theme> remaining;
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			if (auto itr = _themes.find(value.path); itr != _themes.end()) {
+				for (auto const& file : files) {
+					itr->second.pending.erase(file);
+				}
+				remaining = std::make_unique<theme>(itr->second);
+			}
+		}
+		if (remaining && remaining->pending.empty()) {
+			// Everything is there now, so neither the list nor the pack are needed anymore.
+			remove(value.path);
+		} else if (remaining) {
+			save(value.path, *remaining);
+		}
+	}
+
+	// Sources don't notice that their files appeared, so have them load everything again.
+	if (obs_source_t* source = obs_weak_source_get_source(value.source); source) {
+		obs_source_update(source, nullptr);
+		obs_source_release(source);
+	}
+}
+
+void own3d::util::asset_loader::check_source(obs_source_t* source)
+{
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		if (_themes.empty())
+			return;
+	}
+
+	std::vector<std::string> strings;
+	{
+		auto settings = std::shared_ptr<obs_data_t>(obs_source_get_settings(source), own3d::data_deleter);
+		if (!settings)
+			return;
+		collect_strings(settings.get(), strings);
+	}
+
+	std::unique_lock<std::mutex> lock(_lock);
+	for (auto const& kv : _themes) {
+		std::set<std::string> references;
+		for (auto const& text : strings) {
+			find_references(text, kv.second.base, references);
+		}
+		if (references.empty())
+			continue;
+
+		std::set<std::string> files;
+		for (auto const& entry : kv.second.pending) {
+			if (is_referenced(entry, references))
+				files.insert(entry);
+		}
+		if (files.empty())
+			continue;
+
+		_jobs.push_back({kv.first, std::move(files), obs_source_get_weak_source(source)});
+		_cv.notify_all();
+	}
+}
+
+void own3d::util::asset_loader::on_source_activate(void* data, calldata_t* cd)
+try {
+	// Called from the graphics thread, so anything slow happens on the worker instead.
+	auto source = reinterpret_cast<obs_source_t*>(calldata_ptr(cd, "source"));
+	if (source)
+		reinterpret_cast<own3d::util::asset_loader*>(data)->check_source(source);
+} catch (std::exception const& ex) {
+	DLOG_ERROR("Failed to check source for missing theme files: %s", ex.what());
+}
+
+void own3d::util::asset_loader::add(std::filesystem::path const& archive, std::filesystem::path const& path,
+									std::set<std::string> const& pending)
+{
+	remove(path);
+	if (pending.empty())
+		return;
+
+	// The download is only kept until the next theme is installed, so hold on to the pack ourselves.
+	theme value;
+	value.archive = std::filesystem::path(path).append(ARCHIVE_NAME);
+	value.base    = std::filesystem::absolute(path).u8string();
+	value.pending = pending;
+	{
+		std::error_code ec;
+		std::filesystem::create_hard_link(archive, value.archive, ec);
+		if (ec) {
+			std::filesystem::copy_file(archive, value.archive, std::filesystem::copy_options::overwrite_existing);
+		}
+	}
+	save(path, value);
+
+	std::unique_lock<std::mutex> lock(_lock);
+	_themes[path] = std::move(value);
+}
+
+void own3d::util::asset_loader::remove(std::filesystem::path const& path)
+{
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_themes.erase(path);
+	}
+
+	std::error_code ec;
+	auto            archive = std::filesystem::path(path).append(ARCHIVE_NAME);
+	std::filesystem::remove(std::filesystem::path(path).append(PENDING_NAME), ec);
+	std::filesystem::remove(archive, ec);
+	std::filesystem::remove(own3d::util::zip_index::index_path(archive), ec);
+}
+
+void own3d::util::asset_loader::extract_all()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	for (auto const& kv : _themes) {
+		_jobs.push_back({kv.first, {}, nullptr});
+	}
+	_cv.notify_all();
+}
+
+void own3d::util::asset_loader::find_references(std::string_view text, std::string_view prefix,
+												std::set<std::string>& files)
+{
+	if (prefix.empty())
+		return;
+
+	for (size_t pos = text.find(prefix); pos != std::string_view::npos;
+		 pos        = text.find(prefix, pos + prefix.length())) {
+		// Paths may be embedded in other text, like CSS or HTML, so stop at anything that would end them there.
+		size_t      begin = pos + prefix.length();
+		size_t      end   = text.find_first_of("\"'()<>?#\r\n\t", begin);
+		std::string file{text.substr(begin, (end == std::string_view::npos) ? end : end - begin)};
+
+		std::replace(file.begin(), file.end(), '\\', '/');
+		while ((file.length() > 0) && (file.front() == '/'))
+			file.erase(0, 1);
+		while ((file.length() > 0) && ((file.back() == '/') || (file.back() == ' ')))
+			file.pop_back();
+		if (file.length() > 0)
+			files.insert(file);
+	}
+}
+
+bool own3d::util::asset_loader::is_referenced(std::string const& entry, std::set<std::string> const& references)
+{
+	// A reference may also be a directory, which needs everything inside it.
+	for (auto const& reference : references) {
+		if ((entry.length() >= reference.length()) && (entry.compare(0, reference.length(), reference) == 0)
+			&& ((entry.length() == reference.length()) || (entry[reference.length()] == '/')))
+			return true;
+	}
+	return false;
+}
+
+std::shared_ptr<own3d::util::asset_loader> own3d::util::asset_loader::_instance = nullptr;
+
+void own3d::util::asset_loader::initialize()
+{
+	if (!own3d::util::asset_loader::_instance)
+		own3d::util::asset_loader::_instance = std::make_shared<own3d::util::asset_loader>();
+}
+
+void own3d::util::asset_loader::finalize()
+{
+	own3d::util::asset_loader::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::asset_loader> own3d::util::asset_loader::instance()
+{
+	return own3d::util::asset_loader::_instance;
+}
@@ -0,0 +1,108 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <obs.h>
+
+namespace own3d::util {
+	/** Extracts the files of installed themes once they are needed, instead of all of them up front.
+	 *
+	 * A theme installed this way keeps its pack next to the files, and lists the entries that are still
+	 * missing. Whenever a source is activated or shown, its settings are checked for paths into such a
+	 * theme, and the files they refer to are extracted in the background before the source is reloaded.
+	 */
+	class asset_loader {
+		struct theme {
+			std::filesystem::path archive;
+			std::string           base; // Absolute path of the theme, as used in the scene collection.
+			std::set<std::string> pending;
+		};
+
+		struct job {
+			std::filesystem::path path;
+			std::set<std::string> files; // Empty for all pending files.
+			obs_weak_source_t*    source;
+		};
+
+		std::mutex                             _lock;
+		std::condition_variable                _cv;
+		std::map<std::filesystem::path, theme> _themes;
+		std::deque<job>                        _jobs;
+		bool                                   _shutdown;
+		std::thread                            _worker;
+
+		void load(std::filesystem::path const& path);
+
+		void save(std::filesystem::path const& path, theme const& value);
+
+		void run();
+
+		void process(job& value);
+
+		void check_source(obs_source_t* source);
+
+		static void on_source_activate(void* data, calldata_t* cd);
+
+		public:
+		~asset_loader();
+		asset_loader();
+
+		/** Remember which files of a freshly installed theme were left in the pack.
+		 *
+		 * The pack is linked (or copied) into the theme, so that it stays around after the download is cleaned up.
+		 */
+		void add(std::filesystem::path const& archive, std::filesystem::path const& path,
+				 std::set<std::string> const& pending);
+
+		/** Forget about a theme, for example because it was installed again with all files. */
+		void remove(std::filesystem::path const& path);
+
+		/** Extract all files that are still missing from any theme. */
+		void extract_all();
+
+		/** Find the files in the pack that a string from a scene collection refers to.
+		 *
+		 * @param prefix The part of the path that leads to the theme, for example "<REPLACE|ME>".
+		 */
+		static void find_references(std::string_view text, std::string_view prefix, std::set<std::string>& files);
+
+		/** Check if an entry is one of the references, or inside a directory that is. */
+		static bool is_referenced(std::string const& entry, std::set<std::string> const& references);
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::asset_loader> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::asset_loader> instance();
+	};
+} // namespace own3d::util
@@ -0,0 +1,255 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blob-store.hpp"
+#include <fstream>
+#include <random>
+#include "plugin.hpp"
+
+// File in the store whose modification time all blobs are given.
+constexpr std::string_view STAMP_NAME = ".stamp";
+
+own3d::util::blob_store::~blob_store() {}
+
+own3d::util::blob_store::blob_store()
+	: _path(), _counter(std::random_device{}()), _lock(), _links(false), _time(), _temporaries()
+{
+	{
+		char* buf = obs_module_config_path("blobs");
+		if (!buf) {
+			throw std::runtime_error("Plugin has no configuration directory, libobs broke.");
+		}
+		_path = std::filesystem::u8path(buf);
+		bfree(buf);
+	}
+	std::filesystem::create_directories(std::filesystem::path(_path).append("tmp"));
+
+	// Taken from a file rather than the clock, so that it is the same in every session, and exactly representable
+	// by the file system.
+	{
+		auto stamp = std::filesystem::path(_path).append(STAMP_NAME);
+		if (!std::filesystem::exists(stamp)) {
+			std::ofstream{stamp, std::ios::binary | std::ios::out};
+		}
+		_time = std::filesystem::last_write_time(stamp);
+	}
+
+	// Find out once if hard links work here, instead of failing to create one for every file.
+	{
+		auto            probe = next_temporary();
+		auto            link  = next_temporary();
+		std::error_code ec;
+		std::ofstream{probe, std::ios::binary | std::ios::out};
+		std::filesystem::create_hard_link(probe, link, ec);
+		_links = !ec;
+		std::filesystem::remove(link, ec);
+		std::filesystem::remove(probe, ec);
+	}
+	if (!_links) {
+		DLOG_WARNING("File system at '%s' doesn't support hard links, themes will not share files.",
+					 _path.u8string().c_str());
+	}
+}
+
+bool own3d::util::blob_store::supports_links()
+{
+	return _links;
+}
+
+std::filesystem::path own3d::util::blob_store::next_temporary()
+{
+	return std::filesystem::path(_path).append("tmp").append(std::to_string(_counter++));
+}
+
+std::filesystem::path own3d::util::blob_store::make_temporary()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	auto                         temporary = next_temporary();
+	_temporaries.insert(temporary);
+	return temporary;
+}
+
+void own3d::util::blob_store::release(std::filesystem::path const& temporary)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	std::error_code              ec;
+	std::filesystem::remove(temporary, ec);
+	_temporaries.erase(temporary);
+}
+
+bool own3d::util::blob_store::is_intact(std::filesystem::path const& blob, uint64_t size)
+{
+	// Writing to the blob through any of its links updates its modification time.
+	std::error_code ec;
+	if ((std::filesystem::file_size(blob, ec) != size) || ec)
+		return false;
+	return (std::filesystem::last_write_time(blob, ec) == _time) && !ec;
+}
+
+void own3d::util::blob_store::commit(std::filesystem::path const& temporary, sha256::digest_t const& digest,
+									 std::filesystem::path const& target)
+{
+	std::string name = sha256::to_string(digest);
+	auto        blob = std::filesystem::path(_path).append(name.substr(0, 2)).append(name);
+
+	// Two commits of the same file must not both add it, and the garbage collection must not see a blob before
+	// the target links to it, as it would look unused.
+	std::unique_lock<std::mutex> lock(_lock);
+	_temporaries.erase(temporary);
+
+	// Link under a temporary name first, so that the target is replaced in a single step. The garbage collection
+	// can't run until it is gone again, so it doesn't need to be tracked.
+	auto            link = next_temporary();
+	std::error_code ec;
+	bool            stored = std::filesystem::exists(blob, ec);
+	if (stored && !is_intact(blob, std::filesystem::file_size(temporary))) {
+		// A theme changed its copy in place. The themes linking to it keep what they have, but the store takes the
+		// new file instead, which the rename below puts in its place.
+		DLOG_DEBUG("Stored file '%s' was changed in place, replacing it.", name.c_str());
+		stored = false;
+	}
+	if (stored) {
+		// Another theme brought the same file already.
+		std::filesystem::create_hard_link(blob, link, ec);
+		if (!ec) {
+			std::filesystem::remove(temporary, ec);
+		}
+	} else {
+		// Link before moving it into the store, so that the blob is never without a theme that uses it.
+		std::filesystem::last_write_time(temporary, _time, ec);
+		std::filesystem::create_hard_link(temporary, link, ec);
+		if (!ec) {
+			std::filesystem::create_directories(blob.parent_path());
+			std::filesystem::rename(temporary, blob);
+		}
+	}
+	if (ec) {
+		// The target can't be linked to the store, so it gets the file itself.
+		std::filesystem::rename(temporary, link);
+	}
+	std::filesystem::rename(link, target);
+}
+
+void own3d::util::blob_store::collect_garbage()
+{
+	uint64_t        files = 0;
+	uint64_t        bytes = 0;
+	std::error_code ec;
+
+	// Commits link blobs in several steps, none of which may be observed halfway.
+	std::unique_lock<std::mutex> lock(_lock);
+
+	// Themes may still be extracting while this runs, so only files which no writer owns are left overs.
+	for (auto const& file : std::filesystem::directory_iterator(std::filesystem::path(_path).append("tmp"), ec)) {
+		if (_temporaries.count(file.path()) == 0)
+			std::filesystem::remove(file.path(), ec);
+	}
+
+	for (auto const& dir : std::filesystem::directory_iterator(_path, ec)) {
+		if (!dir.is_directory(ec) || (dir.path().filename() == "tmp"))
+			continue;
+
+		for (auto const& file : std::filesystem::directory_iterator(dir.path(), ec)) {
+			// Only the store itself refers to this blob.
+			if (file.hard_link_count(ec) != 1)
+				continue;
+
+			uint64_t size = file.file_size(ec);
+			if (std::filesystem::remove(file.path(), ec)) {
+				files++;
+				bytes += size;
+			}
+		}
+	}
+
+	if (files > 0) {
+		DLOG_INFO("Removed %llu unused files (%llu bytes) from the theme store.", files, bytes);
+	}
+}
+
+std::shared_ptr<own3d::util::blob_store> own3d::util::blob_store::_instance = nullptr;
+
+void own3d::util::blob_store::initialize()
+{
+	if (!own3d::util::blob_store::_instance)
+		own3d::util::blob_store::_instance = std::make_shared<own3d::util::blob_store>();
+}
+
+void own3d::util::blob_store::finalize()
+{
+	own3d::util::blob_store::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::blob_store> own3d::util::blob_store::instance()
+{
+	return own3d::util::blob_store::_instance;
+}
+
+own3d::util::blob_writer::~blob_writer()
+{
+	if (!_committed) {
+		_file.reset();
+		if (_store) {
+			_store->release(_temporary);
+		} else {
+			std::error_code ec;
+			std::filesystem::remove(_temporary, ec);
+		}
+	}
+}
+
+own3d::util::blob_writer::blob_writer(std::filesystem::path target, uint64_t size)
+	: _store(blob_store::instance()), _target(target), _temporary(), _file(), _digest(), _committed(false)
+{
+	// Going through a store that can't link only means writing each file twice.
+	if (_store && !_store->supports_links()) {
+		_store.reset();
+	}
+
+	if (_store) {
+		_temporary = _store->make_temporary();
+	} else {
+		_temporary = std::filesystem::path(_target).concat(".tmp");
+	}
+
+	_file = std::make_unique<file_sink>(_temporary, 0, true);
+	if (size > 0) {
+		_file->preallocate(size);
+	}
+}
+
+void own3d::util::blob_writer::write(const char* data, size_t length)
+{
+	if (_store)
+		_digest.update(data, length);
+	if (!_file->write_all(data, length))
+		throw std::runtime_error("Failed to write file.");
+}
+
+void own3d::util::blob_writer::commit()
+{
+	// Preallocation may have reserved more than was written.
+	uint64_t size = _file->offset();
+	_file.reset();
+	std::filesystem::resize_file(_temporary, size);
+
+	if (_store) {
+		_store->commit(_temporary, _digest.finalize(), _target);
+	} else {
+		std::filesystem::rename(_temporary, _target);
+	}
+	_committed = true;
+}
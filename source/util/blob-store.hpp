@@ -0,0 +1,115 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <atomic>
+#include <cinttypes>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include "curl-sink.hpp"
+#include "sha256.hpp"
+
+namespace own3d::util {
+	/** Content-addressed store for extracted theme files.
+	 *
+	 * Every distinct file is kept once, named by its SHA-256, and theme directories hard link to
+	 * it. The link count of a blob is its reference count, so a blob that only the store itself
+	 * links to any more is no longer used by any theme and can be removed.
+	 *
+	 * Editing a theme file in place also changes it for every other theme that links to the same
+	 * blob. The store can't prevent that, but it gives every blob the same modification time, and
+	 * doesn't link a blob whose size or modification time changed to any further themes.
+	 */
+	class blob_store {
+		std::filesystem::path           _path;
+		std::atomic<uint64_t>           _counter;
+		std::mutex                      _lock;
+		bool                            _links;
+		std::filesystem::file_time_type _time;
+
+		// Temporary files that are still being written, which the garbage collection must leave alone.
+		std::set<std::filesystem::path> _temporaries;
+
+		std::filesystem::path next_temporary();
+
+		/** Check if a blob is still the file that was stored, as far as that can be told without hashing it. */
+		bool is_intact(std::filesystem::path const& blob, uint64_t size);
+
+		public:
+		~blob_store();
+		blob_store();
+
+		/** Name for a new temporary file inside the store, so that it can be moved into place.
+		 *
+		 * The file is in use until it is passed to commit() or release().
+		 */
+		std::filesystem::path make_temporary();
+
+		/** Remove a temporary file that won't be committed. */
+		void release(std::filesystem::path const& temporary);
+
+		/** Check if the file system of the store supports hard links, without which it can't share files. */
+		bool supports_links();
+
+		/** Move a completely written file into the store, and link it to the target.
+		 *
+		 * The target is replaced. Should it not be possible to link it to the store, the file is
+		 * moved to the target instead, and the store doesn't keep it.
+		 */
+		void commit(std::filesystem::path const& temporary, sha256::digest_t const& digest,
+					std::filesystem::path const& target);
+
+		/** Remove blobs that no theme links to anymore, and temporary files that are no longer in use. */
+		void collect_garbage();
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::blob_store> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::blob_store> instance();
+	};
+
+	/** Writes an extracted file through the blob store, or next to the target if there is none or it can't link.
+	 *
+	 * Either way the target is only replaced once the file is complete, and never written in
+	 * place, which would also change every other theme that links to the same blob.
+	 */
+	class blob_writer {
+		std::shared_ptr<blob_store> _store;
+		std::filesystem::path       _target;
+		std::filesystem::path       _temporary;
+		std::unique_ptr<file_sink>  _file;
+		sha256                      _digest;
+		bool                        _committed;
+
+		public:
+		~blob_writer();
+
+		/** @param size Final size of the file if known, so that the space for it can be reserved up front. */
+		blob_writer(std::filesystem::path target, uint64_t size = 0);
+
+		void write(const char* data, size_t length);
+
+		/** Finish the file and put it in place of the target. */
+		void commit();
+	};
+} // namespace own3d::util
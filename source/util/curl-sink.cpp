@@ -0,0 +1,191 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "curl-sink.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Don't trust the server with more memory than this up front, the buffer still grows if needed.
+constexpr int64_t BUFFER_MAX_RESERVE = 16 * 1024 * 1024;
+
+own3d::util::curl_sink::~curl_sink() {}
+
+void own3d::util::curl_sink::begin(int64_t) {}
+
+own3d::util::buffer_sink::~buffer_sink() {}
+
+own3d::util::buffer_sink::buffer_sink() : _buffer() {}
+
+void own3d::util::buffer_sink::begin(int64_t length)
+{
+	if (length > 0) {
+		_buffer.reserve(_buffer.size() + static_cast<size_t>(std::min(length, BUFFER_MAX_RESERVE)));
+	}
+}
+
+size_t own3d::util::buffer_sink::write(const char* data, size_t length)
+{
+	_buffer.insert(_buffer.end(), data, data + length);
+	return length;
+}
+
+const char* own3d::util::buffer_sink::data() const
+{
+	return _buffer.data();
+}
+
+size_t own3d::util::buffer_sink::size() const
+{
+	return _buffer.size();
+}
+
+std::string_view own3d::util::buffer_sink::view() const
+{
+	return std::string_view(_buffer.data(), _buffer.size());
+}
+
+void own3d::util::buffer_sink::clear()
+{
+	_buffer.clear();
+}
+
+own3d::util::file_sink::~file_sink()
+{
+#ifdef _WIN32
+	CloseHandle(_file);
+#else
+	close(_file);
+#endif
+}
+
+own3d::util::file_sink::file_sink(std::filesystem::path path, uint64_t offset, bool truncate)
+	: _file(), _offset(truncate ? 0 : offset)
+{
+#ifdef _WIN32
+	// Segments of the same download write to the file at the same time.
+	_file = CreateFileW(path.wstring().c_str(), GENERIC_WRITE | FILE_READ_ATTRIBUTES,
+						FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS,
+						FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open file for writing.");
+	}
+#else
+	_file = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+	if (_file < 0) {
+		throw std::runtime_error("Failed to open file for writing.");
+	}
+#endif
+}
+
+void own3d::util::file_sink::begin(int64_t length)
+{
+	if (length > 0) {
+		preallocate(_offset + static_cast<uint64_t>(length));
+	}
+}
+
+bool own3d::util::file_sink::preallocate(uint64_t size)
+{
+#ifdef _WIN32
+	FILE_STANDARD_INFO info = {};
+	if (!GetFileInformationByHandleEx(_file, FileStandardInfo, &info, sizeof(info)))
+		return false;
+	if (static_cast<uint64_t>(info.EndOfFile.QuadPart) >= size)
+		return true;
+
+	FILE_ALLOCATION_INFO allocation = {};
+	allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+	bool reserved = SetFileInformationByHandle(_file, FileAllocationInfo, &allocation, sizeof(allocation));
+
+	FILE_END_OF_FILE_INFO end = {};
+	end.EndOfFile.QuadPart    = static_cast<LONGLONG>(size);
+	return SetFileInformationByHandle(_file, FileEndOfFileInfo, &end, sizeof(end)) && reserved;
+#else
+	struct stat info;
+	if (fstat(_file, &info) != 0)
+		return false;
+	if (static_cast<uint64_t>(info.st_size) >= size)
+		return true;
+
+	bool reserved = false;
+#if defined(__linux__)
+	// Unlike posix_fallocate(), this doesn't fall back to writing zeros on file systems without support.
+	reserved = (fallocate(_file, 0, 0, static_cast<off_t>(size)) == 0);
+#elif defined(__APPLE__)
+	fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size - info.st_size), 0};
+	if (fcntl(_file, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		reserved        = (fcntl(_file, F_PREALLOCATE, &store) != -1);
+	} else {
+		reserved = true;
+	}
+#endif
+	// Without reserved space, setting the final size at least avoids growing the file over and over.
+	return (ftruncate(_file, static_cast<off_t>(size)) == 0) && reserved;
+#endif
+}
+
+size_t own3d::util::file_sink::write(const char* data, size_t length)
+{
+	return write_all(data, length) ? length : 0;
+}
+
+bool own3d::util::file_sink::write_all(const char* data, size_t length)
+{
+	while (length > 0) {
+#ifdef _WIN32
+		OVERLAPPED ov = {};
+		ov.Offset     = static_cast<DWORD>(_offset & 0xFFFFFFFF);
+		ov.OffsetHigh = static_cast<DWORD>(_offset >> 32);
+
+		DWORD written = 0;
+		DWORD chunk   = static_cast<DWORD>(std::min<size_t>(length, 0x40000000));
+		if (!WriteFile(_file, data, chunk, &written, &ov) || (written == 0)) {
+			return false;
+		}
+#else
+		ssize_t written = pwrite(_file, data, length, static_cast<off_t>(_offset));
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		} else if (written == 0) {
+			return false;
+		}
+#endif
+		data += written;
+		length -= static_cast<size_t>(written);
+		_offset += static_cast<uint64_t>(written);
+	}
+	return true;
+}
+
+uint64_t own3d::util::file_sink::offset()
+{
+	return _offset;
+}
@@ -0,0 +1,107 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cinttypes>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+namespace own3d::util {
+	/** Destination for the body of a util::curl response.
+	 *
+	 * Sinks receive the data straight from libcurl's buffer, without going through
+	 * a std::function or an intermediate stream.
+	 */
+	class curl_sink {
+		public:
+		virtual ~curl_sink();
+
+		/** Called before the first chunk of a response arrives.
+		 * @param length Expected size of the body, or -1 if unknown.
+		 */
+		virtual void begin(int64_t length);
+
+		/** Consume a chunk of the response.
+		 * @return length if everything was consumed, or anything else to fail the transfer.
+		 */
+		virtual size_t write(const char* data, size_t length) = 0;
+	};
+
+	/** Collects the response in contiguous memory, which parsers can read in place. */
+	class buffer_sink : public curl_sink {
+		std::vector<char> _buffer;
+
+		public:
+		~buffer_sink() override;
+		buffer_sink();
+
+		void begin(int64_t length) override;
+
+		size_t write(const char* data, size_t length) override;
+
+		const char* data() const;
+
+		size_t size() const;
+
+		std::string_view view() const;
+
+		void clear();
+	};
+
+	/** Writes the response straight to a file at a given offset, without any user-space buffering.
+	 *
+	 * Writes are positional (pwrite or overlapped WriteFile), so several sinks may write
+	 * different ranges of the same file at once.
+	 */
+	class file_sink : public curl_sink {
+#ifdef _WIN32
+		void* _file;
+#else
+		int _file;
+#endif
+		uint64_t _offset;
+
+		public:
+		~file_sink() override;
+
+		/** Open the file for writing, creating it if necessary.
+		 * @param offset Position at which the first chunk is written.
+		 * @param truncate Discard the current content of the file.
+		 */
+		file_sink(std::filesystem::path path, uint64_t offset = 0, bool truncate = false);
+
+		/** Reserve space for the announced body, see preallocate(). */
+		void begin(int64_t length) override;
+
+		size_t write(const char* data, size_t length) override;
+
+		/** Reserve disk space for the file up front, so that it doesn't fragment while it grows.
+		 *
+		 * The file is extended to the given size if it is smaller, but never shrunk.
+		 * @return false if the file system can't reserve space, in which case it was only extended.
+		 */
+		bool preallocate(uint64_t size);
+
+		/** Write data at the current offset and advance it.
+		 * @return false if not all data could be written.
+		 */
+		bool write_all(const char* data, size_t length);
+
+		/** Position at which the next chunk is written. */
+		uint64_t offset();
+	};
+} // namespace own3d::util
@@ -15,7 +15,72 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "curl.hpp"
+#include "http-engine.hpp"
+#include "http-statistics.hpp"
+#include "throttle.hpp"
+#include <algorithm>
+#include <cctype>
+#include <future>
 #include <sstream>
+#include <stdexcept>
+#include "plugin.hpp"
+
+void own3d::util::curl_share::lock_helper(CURL*, curl_lock_data data, curl_lock_access, util::curl_share* self)
+{
+	self->_locks[data].lock();
+}
+
+void own3d::util::curl_share::unlock_helper(CURL*, curl_lock_data data, util::curl_share* self)
+{
+	self->_locks[data].unlock();
+}
+
+own3d::util::curl_share::~curl_share()
+{
+	curl_share_cleanup(_share);
+}
+
+own3d::util::curl_share::curl_share() : _share(), _locks()
+{
+	_share = curl_share_init();
+	if (!_share) {
+		throw std::runtime_error("Failed to create shared CURL cache.");
+	}
+
+	curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+	curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, &lock_helper);
+	curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, &unlock_helper);
+
+	// Share what makes the next request to the same host cheaper. Connections are not shared, as libcurl doesn't
+	// support using a shared connection cache from several threads at once. Transfers on the http_engine reuse
+	// connections through its multi handle anyway.
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+}
+
+CURLSH* own3d::util::curl_share::get()
+{
+	return _share;
+}
+
+std::shared_ptr<own3d::util::curl_share> own3d::util::curl_share::_instance = nullptr;
+
+void own3d::util::curl_share::initialize()
+{
+	if (!own3d::util::curl_share::_instance)
+		own3d::util::curl_share::_instance = std::make_shared<own3d::util::curl_share>();
+}
+
+void own3d::util::curl_share::finalize()
+{
+	own3d::util::curl_share::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::curl_share> own3d::util::curl_share::instance()
+{
+	return own3d::util::curl_share::_instance;
+}
 
 int32_t own3d::util::curl::debug_helper(CURL* handle, curl_infotype type, char* data, size_t size, util::curl* self)
 {
@@ -72,8 +137,75 @@ size_t own3d::util::curl::read_helper(void* ptr, size_t size, size_t count, util
 
 size_t own3d::util::curl::write_helper(void* ptr, size_t size, size_t count, util::curl* self)
 {
-	if (self->_write_callback) {
-		return self->_write_callback(ptr, size, count);
+	// Responses replayed from the cache don't use any bandwidth.
+	if (self->_throttle && (self->_cache_response_code == 0)) {
+		if (auto throttle = util::throttle::instance(); throttle && !throttle->acquire(size * count)) {
+			// libcurl holds on to the data and delivers it again once we resume.
+			self->_paused = true;
+			return CURL_WRITEFUNC_PAUSE;
+		}
+	}
+
+	auto data = reinterpret_cast<char*>(ptr);
+	if (auto& response = self->_cache_response; response && self->_cache_stored) {
+		// The stored response may yet stand in for an error, so the caller must not see any of the error until then.
+		long code = 0;
+		curl_easy_getinfo(self->_curl, CURLINFO_RESPONSE_CODE, &code);
+		if ((code < 200) || (code >= 300)) {
+			response->body.insert(response->body.end(), data, data + size * count);
+			self->_cache_held = true;
+			return size * count;
+		}
+	}
+
+	size_t written = self->deliver(data, size * count);
+	if (self->_cache_response && (written <= size * count)) {
+		self->_cache_response->body.insert(self->_cache_response->body.end(), data, data + written);
+	}
+	return written;
+}
+
+size_t own3d::util::curl::deliver(const char* data, size_t length)
+{
+	if (_sink) {
+		if (!_sink_started) {
+			curl_off_t content_length = -1;
+			curl_easy_getinfo(_curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+			_sink->begin(static_cast<int64_t>(content_length));
+			_sink_started = true;
+		}
+		return _sink->write(data, length);
+	} else if (_write_callback) {
+		return _write_callback(const_cast<char*>(data), 1, length);
+	}
+	return length;
+}
+
+size_t own3d::util::curl::header_helper(void* ptr, size_t size, size_t count, util::curl* self)
+{
+	if (auto& response = self->_cache_response; response) {
+		std::string_view line{reinterpret_cast<char*>(ptr), size * count};
+		std::string      key, value;
+		if (line.substr(0, 5) == "HTTP/") {
+			// Headers of redirects and interim responses don't apply to the final one.
+			response->etag.clear();
+			response->last_modified.clear();
+			response->max_age                = -1;
+			response->stale_while_revalidate = -1;
+			response->no_store               = false;
+		} else if (parse_header(line, key, value)) {
+			if (key == "etag") {
+				response->etag = value;
+			} else if (key == "last-modified") {
+				response->last_modified = value;
+			} else if (key == "cache-control") {
+				response->parse_cache_control(value);
+			}
+		}
+	}
+
+	if (self->_header_callback) {
+		return self->_header_callback(ptr, size, count);
 	} else {
 		return size * count;
 	}
@@ -90,11 +222,17 @@ int32_t own3d::util::curl::xferinfo_callback(util::curl* self, curl_off_t dlt, c
 	}
 }
 
-own3d::util::curl::curl() : _curl(), _read_callback(), _write_callback(), _headers()
+own3d::util::curl::curl()
+	: _curl(), _share(), _read_callback(), _write_callback(), _header_callback(), _sink(), _sink_started(false),
+	  _headers(), _header_list(), _compression(true), _throttle(false), _paused(false), _prewarm(false),
+	  _url(), _cache(false), _cache_revalidate(false), _cache_stored(), _cache_response(), _cache_response_code(0),
+	  _cache_held(false)
 {
 	_curl = curl_easy_init();
+	attach_share();
 	set_read_callback(nullptr);
 	set_write_callback(nullptr);
+	set_header_callback(nullptr);
 	set_xferinfo_callback(nullptr);
 	set_debug_callback(nullptr);
 
@@ -102,6 +240,13 @@ own3d::util::curl::curl() : _curl(), _read_callback(), _write_callback(), _heade
 	set_option(CURLOPT_NOPROGRESS, false);
 	set_option(CURLOPT_PATH_AS_IS, false);
 	set_option(CURLOPT_CRLF, false);
+	set_compression(_compression);
+
+	// Keep idle connections and lookups around long enough to be reused, for example after pre-warming.
+	set_option(CURLOPT_TCP_KEEPALIVE, 1L);
+	set_option(CURLOPT_TCP_KEEPIDLE, 60L);
+	set_option(CURLOPT_TCP_KEEPINTVL, 30L);
+	set_option(CURLOPT_DNS_CACHE_TIMEOUT, 300L);
 #ifdef _DEBUG
 	set_option(CURLOPT_VERBOSE, true);
 #else
@@ -134,10 +279,12 @@ size_t perform_get_kv_size(std::string a, std::string b)
 	return a.size() + 2 + b.size() + 1;
 };
 
-CURLcode own3d::util::curl::perform()
+void own3d::util::curl::prepare()
 {
-	std::vector<char>  buffer;
-	struct curl_slist* headers = nullptr;
+	std::vector<char> buffer;
+
+	_paused       = false;
+	_sink_started = false;
 
 	if (_headers.size() > 0) {
 		// Calculate full buffer size.
@@ -156,27 +303,270 @@ CURLcode own3d::util::curl::perform()
 
 				snprintf(&buffer.at(buffer_offset), size, "%s: %s", kv.first.c_str(), kv.second.c_str());
 
-				headers = curl_slist_append(headers, &buffer.at(buffer_offset));
+				_header_list = curl_slist_append(_header_list, &buffer.at(buffer_offset));
 
 				buffer_offset += size;
 			}
 		}
-		set_option<struct curl_slist*>(CURLOPT_HTTPHEADER, headers);
+		set_option<struct curl_slist*>(CURLOPT_HTTPHEADER, _header_list);
 	}
+}
 
-	CURLcode res = curl_easy_perform(_curl);
-
-	if (headers) {
+void own3d::util::curl::finish()
+{
+	if (_header_list) {
 		set_option<struct curl_slist*>(CURLOPT_HTTPHEADER, nullptr);
-		curl_slist_free_all(headers);
+		curl_slist_free_all(_header_list);
+		_header_list = nullptr;
 	}
+}
+
+void own3d::util::curl::record_statistics(CURLcode res)
+{
+	auto statistics = util::http_statistics::instance();
+	if (!statistics)
+		return;
 
+	// All times are measured from the start of the transfer, so turn them into the length of each phase.
+	curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0, bytes = 0, speed = 0;
+	long       connects   = 0;
+	curl_easy_getinfo(_curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+	curl_easy_getinfo(_curl, CURLINFO_CONNECT_TIME_T, &connect);
+	curl_easy_getinfo(_curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+	curl_easy_getinfo(_curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+	curl_easy_getinfo(_curl, CURLINFO_TOTAL_TIME_T, &total);
+	curl_easy_getinfo(_curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+	curl_easy_getinfo(_curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+	curl_easy_getinfo(_curl, CURLINFO_NUM_CONNECTS, &connects);
+
+	util::http_timing timing;
+	timing.dns      = namelookup;
+	timing.connect  = std::max<curl_off_t>(connect - namelookup, 0);
+	timing.tls      = (appconnect > 0) ? std::max<curl_off_t>(appconnect - connect, 0) : 0;
+	timing.ttfb     = std::max<curl_off_t>(starttransfer - std::max(appconnect, connect), 0);
+	timing.transfer = std::max<curl_off_t>(total - starttransfer, 0);
+	timing.total    = total;
+	timing.bytes    = static_cast<uint64_t>(bytes);
+	timing.speed    = static_cast<uint64_t>(speed);
+	timing.reused   = (connects == 0);
+
+	long code = 0;
+	curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, &code);
+	statistics->record(_url, (res == CURLE_OK) && (code < 400), timing);
+}
+
+CURLcode own3d::util::curl::perform()
+{
+	// A blocking transfer would hold up every other transfer, or the thread it was called on.
+	auto engine = util::http_engine::instance();
+	if (!engine) {
+		DLOG_ERROR("Unable to perform request to '%s', the transfer engine is not running.", _url.c_str());
+		return CURLE_FAILED_INIT;
+	}
+	if (engine->is_worker_thread()) {
+		DLOG_ERROR("Unable to perform request to '%s' from the transfer engine itself.", _url.c_str());
+		return CURLE_RECURSIVE_API_CALL;
+	}
+
+	// The caller owns this object, so the engine only borrows it. Wait until it let go of it as well as for the
+	// result, as the caller is free to delete this object once we return.
+	std::promise<void>    released;
+	auto                  unused = released.get_future();
+	std::future<CURLcode> result;
+	{
+		std::shared_ptr<util::curl> self(this, [&released](util::curl*) { released.set_value(); });
+		result = engine->submit(self);
+	}
+	CURLcode res = result.get();
+	unused.wait();
 	return res;
 }
 
 void own3d::util::curl::reset()
 {
 	curl_easy_reset(_curl);
+
+	// Resetting clears CURLOPT_SHARE too, so attach to the shared cache again.
+	attach_share();
+	set_compression(_compression);
+}
+
+void own3d::util::curl::set_cache(bool enabled)
+{
+	_cache = enabled;
+}
+
+bool own3d::util::curl::is_cached_response()
+{
+	return _cache_response_code != 0;
+}
+
+void own3d::util::curl::set_compression(bool enabled)
+{
+	_compression = enabled;
+
+	// An empty string offers every encoding this build of libcurl can decode.
+	if (enabled) {
+		set_option(CURLOPT_ACCEPT_ENCODING, "");
+	} else {
+		set_option<const char*>(CURLOPT_ACCEPT_ENCODING, nullptr);
+	}
+}
+
+void own3d::util::curl::set_throttle(bool enabled)
+{
+	_throttle = enabled;
+}
+
+bool own3d::util::curl::resume()
+{
+	if (!_paused)
+		return false;
+
+	if (auto throttle = util::throttle::instance(); _throttle && throttle && !throttle->available())
+		return true;
+
+	// Unpausing may deliver the held back data right away, which can pause the transfer again.
+	_paused = false;
+	curl_easy_pause(_curl, CURLPAUSE_CONT);
+	return _paused;
+}
+
+bool own3d::util::curl::cache_lookup()
+{
+	_cache_response_code = 0;
+	_cache_held          = false;
+	_cache_stored.reset();
+	_cache_response.reset();
+
+	auto cache = util::http_cache::instance();
+	if (!_cache || !cache || _url.empty())
+		return false;
+
+	clear_header("If-None-Match");
+	clear_header("If-Modified-Since");
+
+	auto key   = util::http_cache::make_key("GET", _url);
+	auto entry = std::make_shared<util::http_cache::entry>();
+	if (cache->load(key, *entry)) {
+		if (!_cache_revalidate) {
+			switch (cache->check(*entry)) {
+			case util::http_cache::freshness::FRESH:
+				return cache_replay(*entry) == CURLE_OK;
+			case util::http_cache::freshness::STALE:
+				cache_revalidate();
+				return cache_replay(*entry) == CURLE_OK;
+			case util::http_cache::freshness::EXPIRED:
+				break;
+			}
+		}
+
+		// Let the server tell us if the stored response is still good.
+		if (entry->etag.length() > 0)
+			set_header("If-None-Match", entry->etag);
+		if (entry->last_modified.length() > 0)
+			set_header("If-Modified-Since", entry->last_modified);
+		_cache_stored = entry;
+	}
+
+	_cache_response      = std::make_shared<util::http_cache::entry>();
+	_cache_response->url = _url;
+	return false;
+}
+
+CURLcode own3d::util::curl::cache_complete(CURLcode res)
+{
+	auto response = std::move(_cache_response);
+	auto stored   = std::move(_cache_stored);
+	auto cache    = util::http_cache::instance();
+	bool held     = _cache_held;
+	_cache_held   = false;
+	if (!response || !cache)
+		return res;
+
+	clear_header("If-None-Match");
+	clear_header("If-Modified-Since");
+
+	auto key  = util::http_cache::make_key("GET", _url);
+	long code = 0;
+	if (res == CURLE_OK)
+		curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, &code);
+
+	if ((res == CURLE_OK) && (code == 200)) {
+		response->response_code = code;
+		cache->store(key, *response);
+		return res;
+	}
+
+	if (stored && (res == CURLE_OK) && (code == 304)) {
+		// Keep the stored body, but take over the new validators and lifetime.
+		if (response->etag.length() > 0)
+			stored->etag = response->etag;
+		if (response->last_modified.length() > 0)
+			stored->last_modified = response->last_modified;
+		stored->max_age                = response->max_age;
+		stored->stale_while_revalidate = response->stale_while_revalidate;
+		stored->no_store               = response->no_store;
+		cache->store(key, *stored);
+		return cache_replay(*stored);
+	}
+
+	// Fall back to what we have if the server is unreachable or failed, as long as nothing reached the caller yet.
+	if (stored && (held || response->body.empty()) && (res != CURLE_ABORTED_BY_CALLBACK)
+		&& ((res != CURLE_OK) || (code >= 500)) && cache->usable_on_error(*stored)) {
+		DLOG_WARNING("Request to '%s' failed, using cached response instead.", _url.c_str());
+		return cache_replay(*stored);
+	}
+
+	// The stored response can't stand in, so the caller gets the error after all.
+	if (held && (deliver(response->body.data(), response->body.size()) != response->body.size()))
+		return CURLE_WRITE_ERROR;
+	return res;
+}
+
+CURLcode own3d::util::curl::cache_replay(util::http_cache::entry const& entry)
+{
+	_cache_response_code = entry.response_code;
+	if (entry.body.size() > 0) {
+		if (write_helper(const_cast<char*>(entry.body.data()), 1, entry.body.size(), this) != entry.body.size())
+			return CURLE_WRITE_ERROR;
+	}
+	return CURLE_OK;
+}
+
+void own3d::util::curl::cache_revalidate()
+{
+	auto engine = util::http_engine::instance();
+	if (!engine)
+		return;
+
+	// Copy all options of this request, but none of the callbacks which point back at us.
+	auto request = std::make_shared<util::curl>();
+	curl_easy_cleanup(request->_curl);
+	request->_curl = curl_easy_duphandle(_curl);
+	if (!request->_curl)
+		return;
+	request->attach_share();
+	request->set_read_callback(nullptr);
+	request->set_write_callback(nullptr);
+	request->set_header_callback(nullptr);
+	request->set_xferinfo_callback(nullptr);
+	request->set_debug_callback(nullptr);
+	request->_headers          = _headers;
+	request->_url              = _url;
+	request->_cache            = true;
+	request->_cache_revalidate = true;
+
+	engine->submit(request, [](CURLcode) {});
+}
+
+void own3d::util::curl::attach_share()
+{
+	// Keep the share alive for as long as this handle might use it.
+	_share = util::curl_share::instance();
+	if (_share) {
+		set_option(CURLOPT_SHARE, _share->get());
+	}
 }
 
 CURLcode own3d::util::curl::set_read_callback(curl_io_callback_t cb)
@@ -190,11 +580,28 @@ CURLcode own3d::util::curl::set_read_callback(curl_io_callback_t cb)
 CURLcode own3d::util::curl::set_write_callback(curl_io_callback_t cb)
 {
 	_write_callback = cb;
+	_sink.reset();
 	if (CURLcode res = curl_easy_setopt(_curl, CURLOPT_WRITEDATA, this); res != CURLE_OK)
 		return res;
 	return curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, &write_helper);
 }
 
+CURLcode own3d::util::curl::set_sink(std::shared_ptr<util::curl_sink> sink)
+{
+	// The write helper is always installed, so only the destination changes.
+	_write_callback = nullptr;
+	_sink           = sink;
+	return CURLE_OK;
+}
+
+CURLcode own3d::util::curl::set_header_callback(curl_io_callback_t cb)
+{
+	_header_callback = cb;
+	if (CURLcode res = curl_easy_setopt(_curl, CURLOPT_HEADERDATA, this); res != CURLE_OK)
+		return res;
+	return curl_easy_setopt(_curl, CURLOPT_HEADERFUNCTION, &header_helper);
+}
+
 CURLcode own3d::util::curl::set_xferinfo_callback(curl_xferinfo_callback_t cb)
 {
 	_xferinfo_callback = cb;
@@ -210,3 +617,40 @@ CURLcode own3d::util::curl::set_debug_callback(curl_debug_callback_t cb)
 		return res;
 	return curl_easy_setopt(_curl, CURLOPT_DEBUGFUNCTION, &debug_helper);
 }
+
+bool own3d::util::curl::parse_header(std::string_view line, std::string& key, std::string& value)
+{
+	auto pos = line.find(':');
+	if (pos == std::string_view::npos)
+		return false;
+
+	key = std::string(line.substr(0, pos));
+	std::transform(key.begin(), key.end(), key.begin(), [](char v) { return static_cast<char>(::tolower(v)); });
+
+	std::string_view val = line.substr(pos + 1);
+	while ((val.length() > 0) && ((val.front() == ' ') || (val.front() == '\t')))
+		val.remove_prefix(1);
+	while ((val.length() > 0) && ((val.back() == '\r') || (val.back() == '\n') || (val.back() == ' ')))
+		val.remove_suffix(1);
+	value = std::string(val);
+	return true;
+}
+
+long own3d::util::curl::parse_status(std::string_view line)
+{
+	if (line.substr(0, 5) != "HTTP/")
+		return 0;
+
+	auto pos = line.find(' ');
+	if (pos == std::string_view::npos)
+		return 0;
+	return strtol(std::string(line.substr(pos + 1, 3)).c_str(), nullptr, 10);
+}
+
+std::string own3d::util::curl::if_range_validator(std::string_view etag, std::string_view last_modified)
+{
+	// Weak entity tags are not allowed in If-Range, servers would answer with the whole file every time.
+	if ((etag.length() > 0) && (etag.substr(0, 2) != "W/"))
+		return std::string(etag);
+	return std::string(last_modified);
+}
@@ -19,7 +19,11 @@
 #include <cstring>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 extern "C" {
@@ -29,24 +33,102 @@ extern "C" {
 #include <curl/curl.h>
 }
 
+#include "curl-sink.hpp"
+#include "http-cache.hpp"
+
 namespace own3d::util {
+	class http_engine;
+
 	typedef std::function<size_t(void*, size_t, size_t)>                   curl_io_callback_t;
 	typedef std::function<int32_t(uint64_t, uint64_t, uint64_t, uint64_t)> curl_xferinfo_callback_t;
 	typedef std::function<void(CURL*, curl_infotype, char*, size_t)>       curl_debug_callback_t;
 
+	/** Process-wide cache for DNS lookups, TLS sessions and cookies.
+	 *
+	 * Every util::curl attaches to this automatically while it is initialized,
+	 * so that repeated requests to the same host skip the DNS lookup and can
+	 * resume the TLS session instead of doing a full handshake each time.
+	 */
+	class curl_share {
+		CURLSH*    _share;
+		std::mutex _locks[CURL_LOCK_DATA_LAST];
+
+		static void lock_helper(CURL*, curl_lock_data, curl_lock_access, util::curl_share*);
+		static void unlock_helper(CURL*, curl_lock_data, util::curl_share*);
+
+		public:
+		~curl_share();
+		curl_share();
+
+		CURLSH* get();
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::curl_share> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::curl_share> instance();
+	};
+
 	class curl {
 		CURL*                              _curl;
+		std::shared_ptr<util::curl_share>  _share;
 		curl_io_callback_t                 _read_callback;
 		curl_io_callback_t                 _write_callback;
+		curl_io_callback_t                 _header_callback;
 		curl_xferinfo_callback_t           _xferinfo_callback;
 		curl_debug_callback_t              _debug_callback;
+		std::shared_ptr<util::curl_sink>   _sink;
+		bool                               _sink_started;
 		std::map<std::string, std::string> _headers;
+		struct curl_slist*                 _header_list;
+		bool                               _compression;
+		bool                               _throttle;
+		bool                               _paused;
+		bool                               _prewarm;
+
+		std::string                              _url;
+		bool                                     _cache;
+		bool                                     _cache_revalidate;
+		std::shared_ptr<util::http_cache::entry> _cache_stored;
+		std::shared_ptr<util::http_cache::entry> _cache_response;
+		long                                     _cache_response_code;
+		bool                                     _cache_held; // Body of an error, held back from the caller.
 
+		friend class util::http_engine;
 		static int32_t debug_helper(CURL* handle, curl_infotype type, char* data, size_t size, util::curl* userptr);
 		static size_t  read_helper(void*, size_t, size_t, util::curl*);
 		static size_t  write_helper(void*, size_t, size_t, util::curl*);
+		static size_t  header_helper(void*, size_t, size_t, util::curl*);
 		static int32_t xferinfo_callback(util::curl*, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
 
+		void attach_share();
+
+		/** Hand part of the response body to the sink or write callback. */
+		size_t deliver(const char* data, size_t length);
+
+		void prepare();
+
+		void finish();
+
+		/** Add the timings of the finished transfer to util::http_statistics. */
+		void record_statistics(CURLcode res);
+
+		/** Serve the request from the cache if possible, otherwise make it conditional.
+		 * @return true if the response was delivered from the cache.
+		 */
+		bool cache_lookup();
+
+		/** Store or substitute the response of a finished transfer. */
+		CURLcode cache_complete(CURLcode res);
+
+		CURLcode cache_replay(util::http_cache::entry const& entry);
+
+		void cache_revalidate();
+
 		public:
 		curl();
 		~curl();
@@ -54,7 +136,12 @@ namespace own3d::util {
 		template<typename _Ty1>
 		CURLcode set_option(CURLoption opt, _Ty1 value)
 		{
-			return curl_easy_setopt(_curl, opt, value);
+			// Strings must go through the overload below, which remembers the URL.
+			if constexpr (std::is_convertible_v<_Ty1, const char*>) {
+				return set_option(opt, static_cast<const char*>(value));
+			} else {
+				return curl_easy_setopt(_curl, opt, value);
+			}
 		};
 
 		CURLcode set_option(CURLoption opt, const bool value)
@@ -63,14 +150,22 @@ namespace own3d::util {
 			return curl_easy_setopt(_curl, opt, value ? 1 : 0);
 		};
 
+		CURLcode set_option(CURLoption opt, const char* value)
+		{
+			if (opt == CURLOPT_URL) {
+				_url = value ? value : "";
+			}
+			return curl_easy_setopt(_curl, opt, value);
+		};
+
 		CURLcode set_option(CURLoption opt, const std::string value)
 		{
-			return curl_easy_setopt(_curl, opt, value.c_str());
+			return set_option(opt, value.c_str());
 		};
 
 		CURLcode set_option(CURLoption opt, const std::string_view value)
 		{
-			return curl_easy_setopt(_curl, opt, value.data());
+			return set_option(opt, value.data());
 		};
 
 		template<typename _Ty1>
@@ -79,6 +174,16 @@ namespace own3d::util {
 			return curl_easy_getinfo(_curl, info, &value);
 		};
 
+		CURLcode get_info(CURLINFO info, long& value)
+		{
+			// Responses served from the cache report the code they were stored with.
+			if ((info == CURLINFO_RESPONSE_CODE) && (_cache_response_code != 0)) {
+				value = _cache_response_code;
+				return CURLE_OK;
+			}
+			return curl_easy_getinfo(_curl, info, &value);
+		};
+
 		CURLcode get_info(CURLINFO info, std::vector<char>& value)
 		{
 			char* buffer;
@@ -109,17 +214,69 @@ namespace own3d::util {
 
 		void set_header(std::string header, std::string value);
 
+		/** Run the transfer on the util::http_engine and wait for it to complete.
+		 *
+		 * This blocks the calling thread, so it must not be used from the UI thread or from
+		 * the engine itself. Prefer http_engine::submit() with a callback where possible.
+		 */
 		CURLcode perform();
 
 		void reset();
 
+		/** Allow this GET request to be answered from and stored in the on-disk HTTP cache.
+		 *
+		 * Fresh responses are served without a request, stale ones are served immediately
+		 * and revalidated in the background, and everything else is revalidated with a
+		 * conditional request. If the server can't be reached, a stored response is used.
+		 */
+		void set_cache(bool enabled);
+
+		/** Check if the last response was delivered from the cache. */
+		bool is_cached_response();
+
+		/** Negotiate a Content-Encoding (gzip, brotli, zstd, ...) and decompress the response while it arrives.
+		 *
+		 * Enabled by default. Disable it for files which are compressed already, and for range
+		 * requests, as their offsets would otherwise apply to the encoded representation.
+		 */
+		void set_compression(bool enabled);
+
+		/** Limit this transfer to the bandwidth util::throttle allows for background work. */
+		void set_throttle(bool enabled);
+
+		/** Continue a transfer that was paused by the throttle, once it allows to.
+		 * @return true if the transfer is still paused.
+		 */
+		bool resume();
+
 		public /* Helpers */:
 		CURLcode set_read_callback(curl_io_callback_t cb);
 
 		CURLcode set_write_callback(curl_io_callback_t cb);
 
+		/** Deliver the response body to a sink instead of the write callback. */
+		CURLcode set_sink(std::shared_ptr<util::curl_sink> sink);
+
+		CURLcode set_header_callback(curl_io_callback_t cb);
+
 		CURLcode set_xferinfo_callback(curl_xferinfo_callback_t cb);
 
 		CURLcode set_debug_callback(curl_debug_callback_t cb);
+
+		public /* Utility */:
+		/** Split a response header line into a lower-case key and a trimmed value.
+		 * @return false if the line is not a header, for example the status line.
+		*/
+		static bool parse_header(std::string_view line, std::string& key, std::string& value);
+
+		/** Get the response code from a status line, such as "HTTP/1.1 206 Partial Content".
+		 * @return 0 if the line is not a status line.
+		 */
+		static long parse_status(std::string_view line);
+
+		/** Pick the validator to send in If-Range when resuming a response with these headers.
+		 * @return an empty string if neither is usable, in which case the transfer has to start over.
+		 */
+		static std::string if_range_validator(std::string_view etag, std::string_view last_modified);
 	};
 } // namespace own3d::util
@@ -0,0 +1,739 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "download.hpp"
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include "curl-sink.hpp"
+#include "curl.hpp"
+#include "http-engine.hpp"
+#include "json/json.hpp"
+#include "plugin.hpp"
+#include "retry.hpp"
+
+// How often and for how long a dropped transfer is retried before the download fails.
+constexpr size_t DOWNLOAD_MAX_ATTEMPTS  = 10;
+constexpr auto   DOWNLOAD_RETRY_INITIAL = std::chrono::seconds(1);
+constexpr auto   DOWNLOAD_RETRY_MAXIMUM = std::chrono::seconds(30);
+constexpr auto   DOWNLOAD_RETRY_ELAPSED = std::chrono::minutes(10);
+// How many bytes may be written before the resume information is updated.
+constexpr uint64_t DOWNLOAD_RESUME_INTERVAL = 8 * 1024 * 1024;
+// How long a transfer may stall before it is considered dropped.
+constexpr long DOWNLOAD_STALL_TIMEOUT = 30;
+// Files smaller than this are always downloaded with a single stream.
+constexpr uint64_t SEGMENTED_MIN_SIZE = 32 * 1024 * 1024;
+// Size of the byte ranges that segmented downloads are split into.
+constexpr uint64_t SEGMENTED_CHUNK_SIZE = 8 * 1024 * 1024;
+// Limits for the number of concurrent segments, which is further capped by the connections per host.
+constexpr size_t SEGMENTED_INITIAL_STREAMS = 2;
+constexpr size_t SEGMENTED_MAX_STREAMS     = 8;
+// How long throughput is measured before the number of segments is adjusted.
+constexpr auto SEGMENTED_ADJUST_INTERVAL = std::chrono::seconds(2);
+
+struct resume_info {
+	std::string url;
+	std::string etag;
+	std::string last_modified;
+	uint64_t    offset = 0; // Number of bytes that are known to be complete from the start of the file.
+
+	// Segmented downloads only.
+	uint64_t           size       = 0;
+	uint64_t           chunk_size = 0;
+	std::set<uint64_t> chunks;
+};
+
+static std::filesystem::path resume_info_path(std::filesystem::path path)
+{
+	return path.concat(".resume");
+}
+
+static bool load_resume_info(std::filesystem::path path, resume_info& info)
+try {
+	std::ifstream stream{resume_info_path(path), std::ios::binary | std::ios::in};
+	if (!stream.good() || !std::filesystem::exists(path))
+		return false;
+
+	auto data          = nlohmann::json::parse(stream);
+	info.url           = data.at("url").get<std::string>();
+	info.etag          = data.value("etag", "");
+	info.last_modified = data.value("last_modified", "");
+	info.offset        = std::min<uint64_t>(data.at("offset").get<uint64_t>(), std::filesystem::file_size(path));
+	info.size          = data.value("size", uint64_t(0));
+	info.chunk_size    = data.value("chunk_size", uint64_t(0));
+	if (auto chunks = data.find("chunks"); chunks != data.end()) {
+		info.chunks = chunks->get<std::set<uint64_t>>();
+	}
+	return true;
+} catch (...) {
+	return false;
+}
+
+static void save_resume_info(std::filesystem::path path, resume_info const& info)
+{
+	auto data             = nlohmann::json::object();
+	data["url"]           = info.url;
+	data["etag"]          = info.etag;
+	data["last_modified"] = info.last_modified;
+	data["offset"]        = info.offset;
+	if (info.chunk_size > 0) {
+		data["size"]       = info.size;
+		data["chunk_size"] = info.chunk_size;
+		data["chunks"]     = info.chunks;
+	}
+
+	std::ofstream stream{resume_info_path(path), std::ios::binary | std::ios::trunc | std::ios::out};
+	stream << data.dump();
+}
+
+static void remove_resume_info(std::filesystem::path path)
+{
+	std::error_code ec;
+	std::filesystem::remove(resume_info_path(path), ec);
+}
+
+static std::filesystem::path verified_marker_path(std::filesystem::path path)
+{
+	return path.concat(".sha256");
+}
+
+/** Remove the file before starting it over.
+ *
+ * Truncating it instead would also change the content of any hard links to it, such as the pack of a theme that
+ * was installed from an earlier download.
+ */
+static void discard_file(std::filesystem::path path)
+{
+	std::error_code ec;
+	if (!std::filesystem::remove(path, ec) && ec) {
+		throw std::runtime_error("Failed to replace download file.");
+	}
+}
+
+own3d::util::download::~download() {}
+
+own3d::util::download::download(std::string url, std::filesystem::path path, std::string hash, std::string name)
+	: _url(url), _path(path), _hash(hash), _name(name), _digest(), _digest_offset(0), _progress(), _advance(),
+	  _abort_lock(), _abort_cv(), _abort(false)
+{}
+
+void own3d::util::download::set_progress_callback(progress_callback_t callback)
+{
+	_progress = callback;
+}
+
+void own3d::util::download::set_advance_callback(advance_callback_t callback)
+{
+	_advance = callback;
+}
+
+bool own3d::util::download::update_digest(uint64_t offset)
+{
+	if (_digest_offset > offset) {
+		// The file was started over.
+		_digest.reset();
+		_digest_offset = 0;
+	}
+	if (_digest_offset < offset) {
+		// Only the part that was just completed is read again, which is still in the page cache.
+		// A failed read may have hashed part of the range already, so start over next time.
+		if (!_digest.update_file(_path, _digest_offset, offset - _digest_offset)) {
+			_digest.reset();
+			_digest_offset = 0;
+			return false;
+		}
+		_digest_offset = offset;
+	}
+	return true;
+}
+
+void own3d::util::download::abort()
+{
+	{
+		std::unique_lock<std::mutex> lock(_abort_lock);
+		_abort = true;
+	}
+	_abort_cv.notify_all();
+}
+
+void own3d::util::download::pause_for(std::chrono::milliseconds delay)
+{
+	std::unique_lock<std::mutex> lock(_abort_lock);
+	if (_abort_cv.wait_for(lock, delay, [this]() { return _abort.load(); })) {
+		throw std::runtime_error("Download was aborted.");
+	}
+}
+
+void own3d::util::download::report_progress(uint64_t now, uint64_t total)
+{
+	if (_progress) {
+		_progress(now, total);
+	}
+}
+
+void own3d::util::download::report_advance(uint64_t offset)
+{
+	if (_advance) {
+		_advance(offset);
+	}
+}
+
+void own3d::util::download::fetch()
+{
+	// The file is about to change, so whatever was verified before no longer applies.
+	{
+		std::error_code ec;
+		std::filesystem::remove(verified_marker_path(_path), ec);
+	}
+
+	// Prefer fetching large files in parallel segments, and fall back to a single stream otherwise.
+	if (!fetch_segmented()) {
+		fetch_single();
+	}
+
+	// The file is complete, so there is nothing left to resume.
+	remove_resume_info(_path);
+}
+
+bool own3d::util::download::verify()
+{
+	if (!update_digest(std::filesystem::file_size(_path))) {
+		throw std::runtime_error("Failed to read downloaded file.");
+	}
+	std::string digest = util::sha256::to_string(_digest.finalize());
+	_digest.reset();
+	_digest_offset = 0;
+
+	util::sha256::digest_t expected;
+	if (!util::sha256::from_string(_hash, expected)) {
+		// Nothing was verified, so there must be no marker claiming otherwise, or the file would be reused as is.
+		DLOG_WARNING("Download of %s has no valid SHA-256 hash (%s) to verify against, it hashed to %s.",
+					 _name.c_str(), _hash.c_str(), digest.c_str());
+		std::error_code ec;
+		std::filesystem::remove(verified_marker_path(_path), ec);
+		return true;
+	}
+	if (digest != util::sha256::to_string(expected)) {
+		DLOG_WARNING("Download of %s is damaged, expected SHA-256 %s but got %s.", _name.c_str(),
+					 util::sha256::to_string(expected).c_str(), digest.c_str());
+		return false;
+	}
+
+	std::ofstream stream{verified_marker_path(_path), std::ios::binary | std::ios::trunc | std::ios::out};
+	stream << digest << " " << std::filesystem::file_size(_path);
+	return true;
+}
+
+bool own3d::util::download::reuse()
+try {
+	// Without a hash there is no telling whether the file is still the right one.
+	util::sha256::digest_t expected;
+	if (!util::sha256::from_string(_hash, expected))
+		return false;
+
+	auto          marker = verified_marker_path(_path);
+	std::ifstream stream{marker, std::ios::binary | std::ios::in};
+	std::string   digest;
+	uint64_t      size = 0;
+	if (!(stream >> digest >> size))
+		return false;
+
+	// The file must still be exactly the one that was verified.
+	if ((digest != util::sha256::to_string(expected)) || (size != std::filesystem::file_size(_path))
+		|| (std::filesystem::last_write_time(_path) > std::filesystem::last_write_time(marker))) {
+		return false;
+	}
+	return true;
+} catch (...) {
+	return false;
+}
+
+void own3d::util::download::fetch_single()
+{
+	resume_info resume;
+
+	// Continue where a previous attempt left off, if it was for the same file.
+	if (!load_resume_info(_path, resume) || (resume.url != _url)) {
+		resume     = resume_info();
+		resume.url = _url;
+	} else if (resume.offset > 0) {
+		DLOG_INFO("Resuming download of %s at %llu bytes.", _name.c_str(), resume.offset);
+	}
+	// Only the contiguous part is of use to a single stream.
+	resume.size       = 0;
+	resume.chunk_size = 0;
+	resume.chunks.clear();
+
+	util::backoff retry(DOWNLOAD_RETRY_INITIAL, DOWNLOAD_RETRY_MAXIMUM, DOWNLOAD_RETRY_ELAPSED, DOWNLOAD_MAX_ATTEMPTS);
+	while (true) {
+		// Hash what is already there, so that the rest can be hashed as it arrives.
+		update_digest(resume.offset);
+		report_advance(resume.offset);
+
+		std::unique_ptr<util::file_sink> file;
+		util::curl                       curl;
+		uint64_t                         unsaved       = 0;
+		bool                             checked       = false;
+		long                             response_code = 0;
+		long                             status        = 0;
+		uint64_t                         base          = resume.offset;
+
+		try { // Set up output file.
+			if (resume.offset == 0) {
+				discard_file(_path);
+			}
+			file = std::make_unique<util::file_sink>(_path, resume.offset, resume.offset == 0);
+		} catch (...) {
+			throw std::runtime_error("Failed to open download file.");
+		}
+
+		{ // Begin curl work.
+			// Resuming needs offsets into the file itself, so nothing may be decoded on the way.
+			curl.set_compression(false);
+			curl.set_throttle(true);
+			curl.set_option(CURLOPT_HTTPGET, true);
+			curl.set_option(CURLOPT_URL, _url);
+			curl.set_option(CURLOPT_FOLLOWLOCATION, true);
+			curl.set_option(CURLOPT_FAILONERROR, true);
+			curl.set_option(CURLOPT_LOW_SPEED_LIMIT, 1L);
+			curl.set_option(CURLOPT_LOW_SPEED_TIME, DOWNLOAD_STALL_TIMEOUT);
+			if (resume.offset > 0) {
+				curl.set_option(CURLOPT_RANGE, std::to_string(resume.offset) + "-");
+				// Only accept a partial response if the file on the server is still the same.
+				auto validator = util::curl::if_range_validator(resume.etag, resume.last_modified);
+				if (validator.length() > 0) {
+					curl.set_header("If-Range", validator);
+				}
+			}
+			curl.set_header_callback([&resume, &status](void* buf, size_t n, size_t c) {
+				std::string_view line{reinterpret_cast<char*>(buf), n * c};
+				std::string      key, value;
+				if (long code = util::curl::parse_status(line); code != 0) {
+					// A new response begins (e.g. after a redirect), so forget what we saw so far.
+					status = code;
+					resume.etag.clear();
+					resume.last_modified.clear();
+				} else if (util::curl::parse_header(line, key, value)) {
+					if (key == "etag") {
+						resume.etag = value;
+					} else if (key == "last-modified") {
+						resume.last_modified = value;
+					}
+				}
+				return n * c;
+			});
+			curl.set_write_callback([this, &curl, &file, &resume, &unsaved, &checked, &status](void* buf, size_t n,
+																							 size_t c) {
+				if (!checked) {
+					checked = true;
+
+					// The server ignored our range request and sent the whole file.
+					if ((resume.offset > 0) && (status != 206)) {
+						DLOG_INFO("Server refused to resume download of %s, restarting.", _name.c_str());
+						resume.offset = 0;
+						update_digest(0);
+						report_advance(0);
+						try {
+							file.reset();
+							discard_file(_path);
+							file = std::make_unique<util::file_sink>(_path, 0, true);
+						} catch (...) {
+							return size_t(0);
+						}
+					}
+
+					// Reserve the space for the rest of the file, so that it ends up in one piece on disk.
+					curl_off_t length = 0;
+					if ((curl.get_info(CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, length) == CURLE_OK) && (length > 0)) {
+						file->preallocate(resume.offset + static_cast<uint64_t>(length));
+					}
+				}
+
+				// Written without buffering, so the resume information never gets ahead of the file.
+				if (!file->write_all(reinterpret_cast<const char*>(buf), n * c))
+					return size_t(0);
+
+				// Hashing the data while we have it costs no extra pass over the file.
+				if (_digest_offset == resume.offset) {
+					_digest.update(buf, n * c);
+					_digest_offset += n * c;
+				}
+				resume.offset += n * c;
+				report_advance(resume.offset);
+				unsaved += n * c;
+				if (unsaved >= DOWNLOAD_RESUME_INTERVAL) {
+					save_resume_info(_path, resume);
+					unsaved = 0;
+				}
+				return n * c;
+			});
+			curl.set_xferinfo_callback([this, &base, &status](uint64_t total, uint64_t now, uint64_t, uint64_t) {
+				if (_abort) {
+					return int32_t(1);
+				}
+
+				// Only a partial response continues the earlier attempts, anything else starts from the beginning.
+				// Until the size is known, the part from earlier attempts would look like the whole file.
+				if ((total > 0) && ((status == 200) || (status == 206))) {
+					uint64_t offset = (status == 206) ? base : 0;
+					report_progress(now + offset, total + offset);
+				}
+				return int32_t(0);
+			});
+
+			uint64_t offset = resume.offset;
+			CURLcode res    = curl.perform();
+			curl.get_info(CURLINFO_RESPONSE_CODE, response_code);
+
+			// Persist what we have, so that a retry (or the next download) can continue from here.
+			file.reset();
+
+			if (res == CURLE_OK) {
+				// Don't leave any preallocated space behind should the server have sent less than it announced.
+				std::error_code ec;
+				if (std::filesystem::file_size(_path, ec) > resume.offset) {
+					std::filesystem::resize_file(_path, resume.offset, ec);
+				}
+				break;
+			} else if ((res == CURLE_HTTP_RETURNED_ERROR) && (response_code == 416)) {
+				// The range we asked for no longer exists, start over from the beginning.
+				DLOG_WARNING("Server rejected resume of %s, restarting download.", _name.c_str());
+				resume     = resume_info();
+				resume.url = _url;
+				save_resume_info(_path, resume);
+			} else {
+				save_resume_info(_path, resume);
+			}
+
+			// Only give up on transfers that keep failing without making any progress.
+			std::chrono::milliseconds delay(0);
+			if (resume.offset > offset) {
+				retry.reset();
+			}
+			if ((res != CURLE_HTTP_RETURNED_ERROR) || (response_code != 416)) {
+				if (!util::is_retryable(res, response_code) || !retry.next(delay)) {
+					DLOG_ERROR("Download of %s failed with error: %s", _name.c_str(), curl_easy_strerror(res));
+					throw std::runtime_error("Failed to download file.");
+				}
+			}
+
+			DLOG_WARNING("Download of %s interrupted at %llu bytes (%s), retrying in %lld ms...",
+						 _name.c_str(), resume.offset, curl_easy_strerror(res), static_cast<long long>(delay.count()));
+			pause_for(delay);
+		}
+	}
+}
+
+struct download_segment {
+	std::shared_ptr<own3d::util::curl>      curl;
+	std::unique_ptr<own3d::util::file_sink> file;
+	uint64_t                                index  = 0;
+	uint64_t                                start  = 0;
+	uint64_t                                length = 0;
+	std::atomic<uint64_t>                   received{0};
+	bool                                    rejected = false;
+};
+
+struct download_segment_queue {
+	std::mutex                                                         lock;
+	std::condition_variable                                            cv;
+	std::list<std::pair<std::shared_ptr<download_segment>, CURLcode>> completed;
+};
+
+bool own3d::util::download::fetch_segmented()
+{
+	auto        engine = util::http_engine::instance();
+	resume_info resume;
+	resume_info remote;
+	bool        ranges = false;
+
+	// Segments are driven concurrently by the transfer engine.
+	if (!engine)
+		return false;
+
+	{ // Probe the remote file for its size and range support.
+		util::curl curl;
+		curl.set_compression(false);
+		curl.set_option(CURLOPT_URL, _url);
+		curl.set_option(CURLOPT_NOBODY, true);
+		curl.set_option(CURLOPT_FOLLOWLOCATION, true);
+		curl.set_option(CURLOPT_FAILONERROR, true);
+		curl.set_option(CURLOPT_TIMEOUT, DOWNLOAD_STALL_TIMEOUT);
+		curl.set_header_callback([&remote, &ranges](void* buf, size_t n, size_t c) {
+			std::string_view line{reinterpret_cast<char*>(buf), n * c};
+			std::string      key, value;
+			if (line.substr(0, 5) == "HTTP/") {
+				remote.etag.clear();
+				remote.last_modified.clear();
+				ranges = false;
+			} else if (util::curl::parse_header(line, key, value)) {
+				if (key == "etag") {
+					remote.etag = value;
+				} else if (key == "last-modified") {
+					remote.last_modified = value;
+				} else if (key == "accept-ranges") {
+					ranges = (value.find("bytes") != std::string::npos);
+				}
+			}
+			return n * c;
+		});
+
+		if (CURLcode res = curl.perform(); res != CURLE_OK) {
+			DLOG_DEBUG("Unable to probe %s (%s), using a single stream.", _name.c_str(),
+					   curl_easy_strerror(res));
+			return false;
+		}
+
+		curl_off_t length = -1;
+		curl.get_info(CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, length);
+		if (!ranges || (length < static_cast<curl_off_t>(SEGMENTED_MIN_SIZE))) {
+			return false;
+		}
+
+		remote.url        = _url;
+		remote.size       = static_cast<uint64_t>(length);
+		remote.chunk_size = SEGMENTED_CHUNK_SIZE;
+	}
+
+	// Continue where a previous attempt left off, if it was for the same file.
+	if (load_resume_info(_path, resume) && (resume.url == remote.url) && (resume.etag == remote.etag)
+		&& (resume.last_modified == remote.last_modified)) {
+		if (resume.chunk_size == 0) {
+			// A single stream left off here, so everything before the offset is done.
+			for (uint64_t idx = 0; ((idx + 1) * remote.chunk_size) <= resume.offset; idx++) {
+				remote.chunks.insert(idx);
+			}
+			remote.offset = (resume.offset / remote.chunk_size) * remote.chunk_size;
+		} else if ((resume.chunk_size == remote.chunk_size) && (resume.size == remote.size)) {
+			remote.chunks = resume.chunks;
+			remote.offset = resume.offset;
+		}
+	}
+	resume = remote;
+
+	{ // Allocate the output file, so that segments can be written in any order.
+		if (resume.chunks.size() > 0) {
+			DLOG_INFO("Resuming download of %s with %llu of %llu bytes complete.", _name.c_str(),
+					  static_cast<uint64_t>(resume.chunks.size() * resume.chunk_size), resume.size);
+		}
+		try {
+			if (resume.chunks.size() == 0) {
+				discard_file(_path);
+			}
+			util::file_sink file(_path, 0, resume.chunks.size() == 0);
+			if (!file.preallocate(resume.size)) {
+				DLOG_INFO("Could not reserve space for %s, the file may end up fragmented.", _name.c_str());
+			}
+		} catch (...) {
+			throw std::runtime_error("Failed to open download file.");
+		}
+		// Preallocation never shrinks the file, but a leftover from an older version of the file might be larger.
+		std::filesystem::resize_file(_path, resume.size);
+	}
+
+	auto                                                      queue = std::make_shared<download_segment_queue>();
+	std::map<uint64_t, std::shared_ptr<download_segment>>     active;
+	std::deque<uint64_t>                                      pending;
+	std::map<uint64_t, std::chrono::steady_clock::time_point> delayed;
+	uint64_t                                                  done_bytes = 0;
+	bool                                                      failed     = false;
+
+	util::backoff retry(DOWNLOAD_RETRY_INITIAL, DOWNLOAD_RETRY_MAXIMUM, DOWNLOAD_RETRY_ELAPSED, DOWNLOAD_MAX_ATTEMPTS);
+
+	auto chunk_length = [&resume](uint64_t index) {
+		return std::min<uint64_t>(resume.chunk_size, resume.size - (index * resume.chunk_size));
+	};
+	for (uint64_t idx = 0, edx = (resume.size + resume.chunk_size - 1) / resume.chunk_size; idx < edx; idx++) {
+		if (resume.chunks.count(idx) == 0) {
+			pending.push_back(idx);
+		} else {
+			done_bytes += chunk_length(idx);
+		}
+	}
+
+	// Adaptive concurrency: keep adding segments while throughput scales, and go back to the best number once
+	// another segment no longer helps. More segments than connections would only queue inside libcurl.
+	size_t   max_streams  = std::min<size_t>(SEGMENTED_MAX_STREAMS, engine->get_max_host_transfers());
+	size_t   streams      = std::min<size_t>(SEGMENTED_INITIAL_STREAMS, max_streams);
+	size_t   best_streams = streams;
+	double_t best_rate    = 0.;
+	auto     window_start = std::chrono::steady_clock::now();
+	uint64_t window_bytes = done_bytes;
+
+	auto start_segment = [this, &engine, &queue, &active, &resume, &chunk_length](uint64_t index) {
+		auto segment    = std::make_shared<download_segment>();
+		segment->curl   = std::make_shared<util::curl>();
+		segment->index  = index;
+		segment->start  = index * resume.chunk_size;
+		segment->length = chunk_length(index);
+
+		// Every segment writes its own range of the file, without having to seek.
+		segment->file = std::make_unique<util::file_sink>(_path, segment->start);
+
+		auto* ptr = segment.get();
+		segment->curl->set_compression(false);
+		segment->curl->set_throttle(true);
+		segment->curl->set_option(CURLOPT_HTTPGET, true);
+		segment->curl->set_option(CURLOPT_URL, _url);
+		segment->curl->set_option(CURLOPT_FOLLOWLOCATION, true);
+		segment->curl->set_option(CURLOPT_FAILONERROR, true);
+		segment->curl->set_option(CURLOPT_LOW_SPEED_LIMIT, 1L);
+		segment->curl->set_option(CURLOPT_LOW_SPEED_TIME, DOWNLOAD_STALL_TIMEOUT);
+		segment->curl->set_option(CURLOPT_RANGE, std::to_string(segment->start) + "-"
+													 + std::to_string(segment->start + segment->length - 1));
+		auto validator = util::curl::if_range_validator(resume.etag, resume.last_modified);
+		if (validator.length() > 0) {
+			segment->curl->set_header("If-Range", validator);
+		}
+		segment->curl->set_write_callback([ptr](void* buf, size_t n, size_t c) {
+			if (ptr->received == 0) {
+				// Anything but a partial response means the server changed its mind about ranges.
+				long code = 0;
+				ptr->curl->get_info(CURLINFO_RESPONSE_CODE, code);
+				if (code != 206) {
+					ptr->rejected = true;
+					return size_t(0);
+				}
+			}
+			if ((ptr->received + (n * c)) > ptr->length) {
+				ptr->rejected = true;
+				return size_t(0);
+			}
+
+			if (!ptr->file->write_all(reinterpret_cast<const char*>(buf), n * c))
+				return size_t(0);
+
+			ptr->received += n * c;
+			return n * c;
+		});
+
+		engine->submit(segment->curl, [queue, segment](CURLcode res) {
+			std::unique_lock<std::mutex> lock(queue->lock);
+			queue->completed.emplace_back(segment, res);
+			queue->cv.notify_all();
+		});
+		active.emplace(index, segment);
+	};
+
+	report_progress(done_bytes, resume.size);
+	while (!failed && (!pending.empty() || !active.empty() || !delayed.empty())) {
+		{ // Segments which failed are queued again once their back off has passed.
+			auto now = std::chrono::steady_clock::now();
+			for (auto itr = delayed.begin(); itr != delayed.end();) {
+				if (itr->second <= now) {
+					pending.push_front(itr->first);
+					itr = delayed.erase(itr);
+				} else {
+					itr++;
+				}
+			}
+		}
+
+		while (!pending.empty() && (active.size() < streams)) {
+			start_segment(pending.front());
+			pending.pop_front();
+		}
+
+		// Wait for segments to complete.
+		std::list<std::pair<std::shared_ptr<download_segment>, CURLcode>> completed;
+		{
+			std::unique_lock<std::mutex> lock(queue->lock);
+			queue->cv.wait_for(lock, std::chrono::milliseconds(250), [&queue]() { return !queue->completed.empty(); });
+			completed.swap(queue->completed);
+		}
+		if (_abort) {
+			for (auto& kv : active) {
+				engine->cancel(kv.second->curl);
+			}
+			throw std::runtime_error("Download was aborted.");
+		}
+
+		for (auto& kv : completed) {
+			auto segment = kv.first;
+			long code    = 0;
+			active.erase(segment->index);
+			segment->file.reset();
+			segment->curl->get_info(CURLINFO_RESPONSE_CODE, code);
+
+			if ((kv.second == CURLE_OK) && (segment->received == segment->length)) {
+				done_bytes += segment->length;
+				resume.chunks.insert(segment->index);
+				while ((resume.offset < resume.size) && (resume.chunks.count(resume.offset / resume.chunk_size) > 0)) {
+					resume.offset += chunk_length(resume.offset / resume.chunk_size);
+				}
+				save_resume_info(_path, resume);
+
+				// Segments complete out of order, so the hash and the consumer follow the contiguous part of the file.
+				update_digest(resume.offset);
+				report_advance(resume.offset);
+				retry.reset();
+			} else if (std::chrono::milliseconds delay;
+					   !segment->rejected && util::is_retryable(kv.second, code) && retry.next(delay)) {
+				DLOG_WARNING("Segment %llu of %s interrupted (%s), retrying in %lld ms...", segment->index,
+							 _name.c_str(), curl_easy_strerror(kv.second), static_cast<long long>(delay.count()));
+				delayed.emplace(segment->index, std::chrono::steady_clock::now() + delay);
+			} else {
+				DLOG_WARNING("Segmented download of %s failed (%s), using a single stream.", _name.c_str(),
+							 curl_easy_strerror(kv.second));
+				failed = true;
+			}
+		}
+
+		// Report aggregated progress.
+		uint64_t now_bytes = done_bytes;
+		for (auto& kv : active) {
+			now_bytes += kv.second->received;
+		}
+		report_progress(now_bytes, resume.size);
+
+		// Adjust the number of segments to the measured throughput.
+		if (auto now = std::chrono::steady_clock::now(); (now - window_start) >= SEGMENTED_ADJUST_INTERVAL) {
+			double_t elapsed = std::chrono::duration<double_t>(now - window_start).count();
+			double_t rate    = static_cast<double_t>(std::max<int64_t>(
+                                static_cast<int64_t>(now_bytes) - static_cast<int64_t>(window_bytes), 0))
+							/ elapsed;
+			if (rate > (best_rate * 1.1)) {
+				best_rate    = rate;
+				best_streams = streams;
+				if ((streams < max_streams) && !pending.empty()) {
+					streams++;
+				}
+			} else if (streams > best_streams) {
+				// The last segment added made no difference, so stay with what worked best. The best rate is kept,
+				// as a slower measurement after backing off would otherwise make the next segment look like a gain.
+				streams = best_streams;
+			}
+			window_start = now;
+			window_bytes = now_bytes;
+		}
+	}
+
+	if (failed) {
+		// Stop the remaining segments, and let the single stream continue from the contiguous part.
+		for (auto& kv : active) {
+			engine->cancel(kv.second->curl);
+		}
+		save_resume_info(_path, resume);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,109 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include "sha256.hpp"
+
+namespace own3d::util {
+	/** Downloads a file, continuing where earlier attempts left off, and checks it against a SHA-256 hash.
+	 *
+	 * Large files are fetched in parallel byte ranges if the server supports them. How far the
+	 * download got is kept next to the file, so that it survives failures and restarts of OBS.
+	 */
+	class download {
+		public:
+		/** Called with the number of bytes received, and the size of the file. */
+		typedef std::function<void(uint64_t now, uint64_t total)> progress_callback_t;
+
+		/** Called with the size of the part at the start of the file which is complete.
+		 *
+		 * The offset goes back to 0 whenever the download starts over.
+		 */
+		typedef std::function<void(uint64_t offset)> advance_callback_t;
+
+		private:
+		std::string           _url;
+		std::filesystem::path _path;
+		std::string           _hash;
+		std::string           _name;
+
+		// Hash of the downloaded file, up to the offset.
+		sha256       _digest;
+		uint64_t     _digest_offset;
+
+		progress_callback_t _progress;
+		advance_callback_t  _advance;
+
+		// Set once the download should stop, which also interrupts waiting for a retry.
+		std::mutex              _abort_lock;
+		std::condition_variable _abort_cv;
+		std::atomic<bool>       _abort;
+
+		public:
+		~download();
+
+		/** @param name Describes the download in log messages, for example "Theme 'Name'". */
+		download(std::string url, std::filesystem::path path, std::string hash, std::string name);
+
+		void set_progress_callback(progress_callback_t callback);
+
+		void set_advance_callback(advance_callback_t callback);
+
+		/** Stop the download as soon as possible, which makes fetch() throw. */
+		void abort();
+
+		/** Check if a previously verified download can be used as is. */
+		bool reuse();
+
+		/** Download the file, continuing an earlier attempt at the same URL if there is one.
+		 *
+		 * Transfers that drop are retried for a while, after which this throws.
+		 */
+		void fetch();
+
+		/** Check the downloaded file against the hash, and remember it as verified if it matches.
+		 *
+		 * A download without a valid SHA-256 hash can't be checked, so it is accepted with a
+		 * warning, but never remembered as verified.
+		 */
+		bool verify();
+
+		private:
+		/** Wait for the delay to pass, or throw if the download is aborted in the meantime. */
+		void pause_for(std::chrono::milliseconds delay);
+
+		/** Catch the hash up with the part of the file that is complete.
+		 * @return false if the file couldn't be read, in which case the next call tries again.
+		 */
+		bool update_digest(uint64_t offset);
+
+		void report_progress(uint64_t now, uint64_t total);
+
+		void report_advance(uint64_t offset);
+
+		void fetch_single();
+
+		bool fetch_segmented();
+	};
+} // namespace own3d::util
@@ -0,0 +1,303 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "http-cache.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include "json/json.hpp"
+#include "plugin.hpp"
+
+constexpr std::string_view CFG_CACHE_TTL   = "cache.ttl";
+constexpr std::string_view CFG_CACHE_STALE = "cache.stale";
+constexpr std::string_view CFG_CACHE_SIZE  = "cache.size";
+
+constexpr int64_t DEFAULT_CACHE_TTL   = 300;   // 5 minutes
+constexpr int64_t DEFAULT_CACHE_STALE = 86400; // 1 day
+constexpr int64_t DEFAULT_CACHE_SIZE  = 32;    // MiB
+
+// Expired entries are still better than nothing while own3d.pro is unreachable.
+constexpr int64_t MAX_STALE_ON_ERROR = 7 * 86400;
+
+static int64_t unix_time()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+		.count();
+}
+
+void own3d::util::http_cache::entry::parse_cache_control(std::string_view value)
+{
+	while (value.length() > 0) {
+		size_t           pos       = value.find(',');
+		std::string_view directive = value.substr(0, pos);
+		value                      = (pos == std::string_view::npos) ? std::string_view() : value.substr(pos + 1);
+
+		while ((directive.length() > 0) && (directive.front() == ' '))
+			directive.remove_prefix(1);
+		while ((directive.length() > 0) && (directive.back() == ' '))
+			directive.remove_suffix(1);
+
+		std::string      name;
+		std::string_view argument;
+		if (size_t eq = directive.find('='); eq != std::string_view::npos) {
+			name     = std::string(directive.substr(0, eq));
+			argument = directive.substr(eq + 1);
+		} else {
+			name = std::string(directive);
+		}
+		std::transform(name.begin(), name.end(), name.begin(), [](char v) { return static_cast<char>(::tolower(v)); });
+
+		if (name == "max-age") {
+			max_age = strtoll(std::string(argument).c_str(), nullptr, 10);
+		} else if (name == "stale-while-revalidate") {
+			stale_while_revalidate = strtoll(std::string(argument).c_str(), nullptr, 10);
+		} else if (name == "no-cache") {
+			max_age = 0;
+		} else if ((name == "no-store") || (name == "private")) {
+			// "private" is fine for a single-user cache, but the API only uses it for personal data.
+			no_store = true;
+		}
+	}
+}
+
+own3d::util::http_cache::~http_cache() {}
+
+own3d::util::http_cache::http_cache()
+	: _path(), _lock(), _ttl(DEFAULT_CACHE_TTL), _stale(DEFAULT_CACHE_STALE),
+	  _max_size(DEFAULT_CACHE_SIZE * 1024 * 1024)
+{
+	{
+		char* buf = obs_module_config_path("cache/http");
+		if (!buf) {
+			throw std::runtime_error("Plugin has no configuration directory, libobs broke.");
+		}
+		_path = std::filesystem::u8path(buf);
+		bfree(buf);
+	}
+	std::filesystem::create_directories(_path);
+
+	if (auto cfg = own3d::configuration::instance(); cfg) {
+		auto data = cfg->get();
+		obs_data_set_default_int(data.get(), CFG_CACHE_TTL.data(), DEFAULT_CACHE_TTL);
+		obs_data_set_default_int(data.get(), CFG_CACHE_STALE.data(), DEFAULT_CACHE_STALE);
+		obs_data_set_default_int(data.get(), CFG_CACHE_SIZE.data(), DEFAULT_CACHE_SIZE);
+		_ttl      = std::max<int64_t>(obs_data_get_int(data.get(), CFG_CACHE_TTL.data()), 0);
+		_stale    = std::max<int64_t>(obs_data_get_int(data.get(), CFG_CACHE_STALE.data()), 0);
+		_max_size = static_cast<uint64_t>(std::max<int64_t>(obs_data_get_int(data.get(), CFG_CACHE_SIZE.data()), 0))
+					* 1024 * 1024;
+	}
+
+	std::unique_lock<std::mutex> lock(_lock);
+	trim();
+}
+
+std::filesystem::path own3d::util::http_cache::entry_path(std::string_view key)
+{
+	// FNV-1a, which is stable across platforms and runs unlike std::hash.
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : key) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ull;
+	}
+
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+	return std::filesystem::path(_path).append(buf);
+}
+
+void own3d::util::http_cache::trim()
+{
+	struct item {
+		std::filesystem::path path;
+		uint64_t              size;
+		int64_t               stored;
+	};
+	std::vector<item> items;
+	uint64_t          total = 0;
+
+	std::error_code ec;
+	for (auto const& file : std::filesystem::directory_iterator(_path, ec)) {
+		if (file.path().extension() != ".json")
+			continue;
+
+		auto body = std::filesystem::path(file.path()).replace_extension(".bin");
+		item it;
+		it.path   = std::filesystem::path(file.path()).replace_extension();
+		it.size   = file.file_size(ec) + std::filesystem::file_size(body, ec);
+		it.stored = file.last_write_time(ec).time_since_epoch().count();
+		total += it.size;
+		items.push_back(it);
+	}
+	if (total <= _max_size)
+		return;
+
+	// Drop the oldest entries first.
+	std::sort(items.begin(), items.end(), [](item const& a, item const& b) { return a.stored < b.stored; });
+	for (auto const& it : items) {
+		if (total <= _max_size)
+			break;
+		std::filesystem::remove(std::filesystem::path(it.path).concat(".json"), ec);
+		std::filesystem::remove(std::filesystem::path(it.path).concat(".bin"), ec);
+		total -= it.size;
+	}
+}
+
+bool own3d::util::http_cache::load(std::string_view key, entry& value)
+try {
+	std::unique_lock<std::mutex> lock(_lock);
+	auto                         path = entry_path(key);
+
+	std::ifstream meta{std::filesystem::path(path).concat(".json"), std::ios::binary | std::ios::in};
+	if (!meta.good())
+		return false;
+	auto data = nlohmann::json::parse(meta);
+	if (data.value("key", "") != key)
+		return false;
+
+	value.url                    = data.value("url", "");
+	value.etag                   = data.value("etag", "");
+	value.last_modified          = data.value("last_modified", "");
+	value.response_code          = data.value("code", 200l);
+	value.stored                 = data.value("stored", int64_t(0));
+	value.max_age                = data.value("max_age", int64_t(-1));
+	value.stale_while_revalidate = data.value("stale_while_revalidate", int64_t(-1));
+	value.no_store               = false;
+
+	std::ifstream body{std::filesystem::path(path).concat(".bin"), std::ios::binary | std::ios::in | std::ios::ate};
+	if (!body.good())
+		return false;
+	value.body.resize(static_cast<size_t>(body.tellg()));
+	body.seekg(0);
+	body.read(value.body.data(), value.body.size());
+	return body.good() || body.eof();
+} catch (std::exception const& ex) {
+	DLOG_WARNING("Ignoring damaged cache entry: %s", ex.what());
+	return false;
+}
+
+void own3d::util::http_cache::store(std::string_view key, entry const& value)
+try {
+	if (value.no_store) {
+		remove(key);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(_lock);
+	auto                         path = entry_path(key);
+	auto                         meta = std::filesystem::path(path).concat(".json");
+	auto                         body = std::filesystem::path(path).concat(".bin");
+
+	{ // Write to temporary files first, so that a crash can't leave a mismatched entry behind.
+		std::ofstream stream{std::filesystem::path(body).concat(".tmp"),
+							 std::ios::binary | std::ios::trunc | std::ios::out};
+		stream.write(value.body.data(), value.body.size());
+		if (!stream.good())
+			throw std::runtime_error("Failed to write response body.");
+	}
+	{
+		auto data                      = nlohmann::json::object();
+		data["key"]                    = key;
+		data["url"]                    = value.url;
+		data["etag"]                   = value.etag;
+		data["last_modified"]          = value.last_modified;
+		data["code"]                   = value.response_code;
+		data["stored"]                 = unix_time();
+		data["max_age"]                = value.max_age;
+		data["stale_while_revalidate"] = value.stale_while_revalidate;
+
+		std::ofstream stream{std::filesystem::path(meta).concat(".tmp"),
+							 std::ios::binary | std::ios::trunc | std::ios::out};
+		stream << data.dump();
+		if (!stream.good())
+			throw std::runtime_error("Failed to write response metadata.");
+	}
+	std::filesystem::rename(std::filesystem::path(body).concat(".tmp"), body);
+	std::filesystem::rename(std::filesystem::path(meta).concat(".tmp"), meta);
+
+	trim();
+} catch (std::exception const& ex) {
+	DLOG_WARNING("Failed to cache response for '%s': %s", value.url.c_str(), ex.what());
+}
+
+void own3d::util::http_cache::remove(std::string_view key)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	auto                         path = entry_path(key);
+	std::error_code              ec;
+	std::filesystem::remove(std::filesystem::path(path).concat(".json"), ec);
+	std::filesystem::remove(std::filesystem::path(path).concat(".bin"), ec);
+}
+
+void own3d::util::http_cache::clear()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	std::error_code              ec;
+	std::filesystem::remove_all(_path, ec);
+	std::filesystem::create_directories(_path, ec);
+}
+
+own3d::util::http_cache::freshness own3d::util::http_cache::check(entry const& value)
+{
+	int64_t age = unix_time() - value.stored;
+	if (age < 0) // The clock went backwards, so we can't trust anything.
+		return freshness::EXPIRED;
+
+	int64_t lifetime = (value.max_age >= 0) ? value.max_age : _ttl;
+	if (age < lifetime)
+		return freshness::FRESH;
+
+	int64_t stale = (value.stale_while_revalidate >= 0) ? value.stale_while_revalidate : _stale;
+	if (age < (lifetime + stale))
+		return freshness::STALE;
+
+	return freshness::EXPIRED;
+}
+
+bool own3d::util::http_cache::usable_on_error(entry const& value)
+{
+	int64_t age = unix_time() - value.stored;
+	return (age >= 0) && (age < MAX_STALE_ON_ERROR);
+}
+
+std::string own3d::util::http_cache::make_key(std::string_view method, std::string_view url)
+{
+	std::string key;
+	key.reserve(method.length() + 1 + url.length());
+	key.append(method);
+	key.append(" ");
+	key.append(url);
+	return key;
+}
+
+std::shared_ptr<own3d::util::http_cache> own3d::util::http_cache::_instance = nullptr;
+
+void own3d::util::http_cache::initialize()
+{
+	if (!own3d::util::http_cache::_instance)
+		own3d::util::http_cache::_instance = std::make_shared<own3d::util::http_cache>();
+}
+
+void own3d::util::http_cache::finalize()
+{
+	own3d::util::http_cache::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::http_cache> own3d::util::http_cache::instance()
+{
+	return own3d::util::http_cache::_instance;
+}
@@ -0,0 +1,98 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cinttypes>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace own3d::util {
+	/** On-disk cache for HTTP responses, keyed by method and URL.
+	 *
+	 * Entries honour Cache-Control (max-age, no-cache, no-store, stale-while-revalidate)
+	 * and otherwise fall back to the configured time to live. The total size of all
+	 * entries is capped, and the least recently stored entries are removed first.
+	 */
+	class http_cache {
+		public:
+		struct entry {
+			std::string       url;
+			std::string       etag;
+			std::string       last_modified;
+			long              response_code          = 200;
+			int64_t           stored                 = 0;  // Unix time at which the response was received.
+			int64_t           max_age                = -1; // Seconds the response is fresh for, -1 if unknown.
+			int64_t           stale_while_revalidate = -1; // Seconds the response may be served stale, -1 if unknown.
+			bool              no_store               = false;
+			std::vector<char> body;
+
+			/** Apply the directives of a Cache-Control header. */
+			void parse_cache_control(std::string_view value);
+		};
+
+		enum class freshness {
+			FRESH,   // May be used without asking the server.
+			STALE,   // May be used, but should be revalidated in the background.
+			EXPIRED, // Must be revalidated before use.
+		};
+
+		private:
+		std::filesystem::path _path;
+		std::mutex            _lock;
+		int64_t               _ttl;
+		int64_t               _stale;
+		uint64_t              _max_size;
+
+		std::filesystem::path entry_path(std::string_view key);
+
+		void trim();
+
+		public:
+		~http_cache();
+		http_cache();
+
+		bool load(std::string_view key, entry& value);
+
+		/** Store an entry, which also marks it as received just now. */
+		void store(std::string_view key, entry const& value);
+
+		void remove(std::string_view key);
+
+		/** Remove all stored entries. */
+		void clear();
+
+		freshness check(entry const& value);
+
+		/** Check if an expired entry may still be used because the server can't be reached. */
+		bool usable_on_error(entry const& value);
+
+		static std::string make_key(std::string_view method, std::string_view url);
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::http_cache> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::http_cache> instance();
+	};
+} // namespace own3d::util
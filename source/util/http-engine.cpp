@@ -0,0 +1,379 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "http-engine.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "plugin.hpp"
+#include "retry.hpp"
+#include "throttle.hpp"
+
+// curl_multi_poll() and curl_multi_wakeup() were added in 7.68.0, older versions
+// have to fall back to polling with a short timeout.
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define HAVE_CURL_MULTI_WAKEUP
+#endif
+
+constexpr size_t DEFAULT_MAX_TRANSFERS      = 8;
+constexpr long   DEFAULT_MAX_HOST_TRANSFERS = 6;
+
+#ifdef HAVE_CURL_MULTI_WAKEUP
+constexpr int POLL_TIMEOUT_MS = 1000;
+#else
+constexpr int POLL_TIMEOUT_MS = 50;
+#endif
+
+// How often paused transfers check if they may continue.
+constexpr int THROTTLE_POLL_MS = 50;
+
+own3d::util::http_engine::~http_engine()
+{
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_shutdown = true;
+	}
+	wakeup();
+	if (_worker.joinable())
+		_worker.join();
+
+	curl_multi_cleanup(_multi);
+}
+
+own3d::util::http_engine::http_engine()
+	: _multi(), _worker(), _lock(), _cv(), _shutdown(false), _max_transfers(DEFAULT_MAX_TRANSFERS), _pending(),
+	  _delayed(), _cancel(), _active()
+{
+	_multi = curl_multi_init();
+	if (!_multi) {
+		throw std::runtime_error("Failed to create CURL multi handle.");
+	}
+	curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, DEFAULT_MAX_HOST_TRANSFERS);
+
+	_worker = std::thread(std::bind(&own3d::util::http_engine::runner, this));
+}
+
+void own3d::util::http_engine::runner()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	while (!_shutdown) {
+		// Remove cancelled transfers before they can complete.
+		if (!_cancel.empty()) {
+			for (auto handle : _cancel) {
+				if (auto kv = _active.find(handle->_curl); kv != _active.end()) {
+					curl_multi_remove_handle(_multi, kv->first);
+					kv->second->handle->finish();
+					_active.erase(kv);
+				}
+			}
+			_cancel.clear();
+			_cv.notify_all();
+		}
+
+		// Queue delayed transfers which are due.
+		int timeout = POLL_TIMEOUT_MS;
+		for (auto now = std::chrono::steady_clock::now(); !_delayed.empty();) {
+			auto itr = _delayed.begin();
+			if (itr->first > now) {
+				auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(itr->first - now).count();
+				timeout        = static_cast<int>(std::min<long long>(timeout, remaining + 1));
+				break;
+			}
+			_pending.push_back(itr->second);
+			_delayed.erase(itr);
+		}
+
+		// Start as many queued transfers as the limit allows.
+		while (!_pending.empty() && (_active.size() < _max_transfers)) {
+			auto item = _pending.front();
+			_pending.pop_front();
+
+			// Answer from the cache if the response is still usable. This may queue a revalidation, so unlock first.
+			lock.unlock();
+			if (item->handle->cache_lookup()) {
+				complete(item, CURLE_OK);
+				lock.lock();
+				continue;
+			}
+			lock.lock();
+
+			// Fail fast while the endpoint is known to be down, instead of adding to its load. Pre-warming must not
+			// use up the trial request, as it doesn't report back.
+			auto breaker = util::circuit_breaker::instance();
+			if (breaker && !item->handle->_prewarm && !breaker->allow(item->handle->_url)) {
+				lock.unlock();
+				complete(item, item->handle->cache_complete(CURLE_COULDNT_CONNECT));
+				lock.lock();
+				continue;
+			}
+
+			item->handle->prepare();
+			if (CURLMcode res = curl_multi_add_handle(_multi, item->handle->_curl); res != CURLM_OK) {
+				DLOG_ERROR("Failed to start transfer: %s", curl_multi_strerror(res));
+				item->handle->finish();
+				lock.unlock();
+				complete(item, item->handle->cache_complete(CURLE_FAILED_INIT));
+				lock.lock();
+				continue;
+			}
+			_active.emplace(item->handle->_curl, item);
+		}
+		lock.unlock();
+
+		int running = 0;
+		curl_multi_perform(_multi, &running);
+
+		// Collect finished transfers.
+		std::list<std::pair<std::shared_ptr<task>, CURLcode>> done;
+		int                                                   remaining = 0;
+		while (CURLMsg* msg = curl_multi_info_read(_multi, &remaining)) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			curl_multi_remove_handle(_multi, msg->easy_handle);
+			if (auto kv = _active.find(msg->easy_handle); kv != _active.end()) {
+				// Pre-warming only opens a connection, so its outcome says nothing about the endpoint.
+				auto breaker = util::circuit_breaker::instance();
+				if (breaker && !kv->second->handle->_prewarm) {
+					long code = 0;
+					curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+					if (util::is_retryable(msg->data.result, code)) {
+						breaker->report(kv->second->handle->_url, false);
+					} else if (msg->data.result == CURLE_OK) {
+						breaker->report(kv->second->handle->_url, true);
+					}
+				}
+
+				kv->second->handle->finish();
+				if (!kv->second->handle->_prewarm) {
+					kv->second->handle->record_statistics(msg->data.result);
+				}
+				done.emplace_back(kv->second, msg->data.result);
+				_active.erase(kv);
+			}
+		}
+
+		// Complete them outside of the lock, so that callbacks may queue new work.
+		for (auto& kv : done) {
+			complete(kv.first, kv.first->handle->cache_complete(kv.second));
+		}
+		done.clear();
+
+		// Paused transfers don't wake up the poll, so look after them ourselves.
+		for (auto& kv : _active) {
+			if (kv.second->handle->resume()) {
+				timeout = std::min(timeout, THROTTLE_POLL_MS);
+			}
+		}
+
+#ifdef HAVE_CURL_MULTI_WAKEUP
+		curl_multi_poll(_multi, nullptr, 0, timeout, nullptr);
+#else
+		curl_multi_wait(_multi, nullptr, 0, timeout, nullptr);
+#endif
+
+		lock.lock();
+	}
+
+	// Abort anything that is still queued or running.
+	std::list<std::shared_ptr<task>> aborted;
+	for (auto kv : _active) {
+		curl_multi_remove_handle(_multi, kv.first);
+		kv.second->handle->finish();
+		aborted.push_back(kv.second);
+	}
+	_active.clear();
+	aborted.splice(aborted.end(), _pending);
+	for (auto kv : _delayed) {
+		aborted.push_back(kv.second);
+	}
+	_delayed.clear();
+	_cancel.clear();
+	_cv.notify_all();
+	lock.unlock();
+
+	for (auto item : aborted) {
+		try {
+			item->callback(CURLE_ABORTED_BY_CALLBACK);
+		} catch (...) {
+		}
+	}
+}
+
+void own3d::util::http_engine::complete(std::shared_ptr<task> const& item, CURLcode res)
+{
+	try {
+		item->callback(res);
+	} catch (std::exception const& ex) {
+		DLOG_ERROR("Transfer completion handler failed with error: %s", ex.what());
+	} catch (...) {
+		DLOG_ERROR("Transfer completion handler failed.");
+	}
+}
+
+void own3d::util::http_engine::wakeup()
+{
+#ifdef HAVE_CURL_MULTI_WAKEUP
+	curl_multi_wakeup(_multi);
+#endif
+}
+
+void own3d::util::http_engine::submit(std::shared_ptr<util::curl> handle, http_engine_callback_t callback)
+{
+	auto item      = std::make_shared<task>();
+	item->handle   = handle;
+	item->callback = callback;
+
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		if (_shutdown) {
+			lock.unlock();
+			callback(CURLE_ABORTED_BY_CALLBACK);
+			return;
+		}
+		_pending.push_back(item);
+	}
+	wakeup();
+}
+
+std::future<CURLcode> own3d::util::http_engine::submit(std::shared_ptr<util::curl> handle)
+{
+	auto promise = std::make_shared<std::promise<CURLcode>>();
+	submit(handle, [promise](CURLcode res) { promise->set_value(res); });
+	return promise->get_future();
+}
+
+void own3d::util::http_engine::schedule(std::chrono::milliseconds delay, std::shared_ptr<util::curl> handle,
+										http_engine_callback_t callback)
+{
+	if (delay.count() <= 0) {
+		submit(handle, callback);
+		return;
+	}
+
+	auto item      = std::make_shared<task>();
+	item->handle   = handle;
+	item->callback = callback;
+
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		if (_shutdown) {
+			lock.unlock();
+			callback(CURLE_ABORTED_BY_CALLBACK);
+			return;
+		}
+		_delayed.emplace(std::chrono::steady_clock::now() + delay, item);
+	}
+	wakeup();
+}
+
+void own3d::util::http_engine::cancel(std::shared_ptr<util::curl> handle)
+{
+	if (!handle)
+		return;
+
+	std::unique_lock<std::mutex> lock(_lock);
+
+	// Queued transfers can simply be dropped.
+	for (auto itr = _pending.begin(); itr != _pending.end(); itr++) {
+		if ((*itr)->handle == handle) {
+			_pending.erase(itr);
+			return;
+		}
+	}
+	for (auto itr = _delayed.begin(); itr != _delayed.end(); itr++) {
+		if (itr->second->handle == handle) {
+			_delayed.erase(itr);
+			return;
+		}
+	}
+
+	if (is_worker_thread()) {
+		// Called from a completion handler, so we can't wait for ourselves.
+		if (auto kv = _active.find(handle->_curl); kv != _active.end()) {
+			curl_multi_remove_handle(_multi, kv->first);
+			kv->second->handle->finish();
+			_active.erase(kv);
+		}
+		return;
+	}
+
+	if (_shutdown)
+		return;
+
+	// Let the worker remove it, and wait until it did.
+	_cancel.push_back(handle.get());
+	wakeup();
+	_cv.wait(lock, [this, &handle]() {
+		for (auto ptr : _cancel) {
+			if (ptr == handle.get())
+				return false;
+		}
+		return true;
+	});
+}
+
+std::shared_ptr<own3d::util::curl> own3d::util::http_engine::prewarm(std::string_view url)
+{
+	// A HEAD request, as connect-only connections can't be reused by other requests.
+	auto handle      = std::make_shared<util::curl>();
+	handle->_prewarm = true;
+	handle->set_option(CURLOPT_URL, url);
+	handle->set_option(CURLOPT_NOBODY, true);
+	handle->set_option(CURLOPT_TIMEOUT, 30L);
+	submit(handle, [url = std::string(url)](CURLcode res) {
+		if ((res != CURLE_OK) && (res != CURLE_ABORTED_BY_CALLBACK)) {
+			DLOG_DEBUG("Failed to pre-warm connection to '%s': %s", url.c_str(), curl_easy_strerror(res));
+		}
+	});
+	return handle;
+}
+
+void own3d::util::http_engine::set_max_transfers(size_t limit)
+{
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_max_transfers = std::max<size_t>(limit, 1);
+	}
+	wakeup();
+}
+
+size_t own3d::util::http_engine::get_max_host_transfers()
+{
+	return static_cast<size_t>(DEFAULT_MAX_HOST_TRANSFERS);
+}
+
+bool own3d::util::http_engine::is_worker_thread()
+{
+	return std::this_thread::get_id() == _worker.get_id();
+}
+
+std::shared_ptr<own3d::util::http_engine> own3d::util::http_engine::_instance = nullptr;
+
+void own3d::util::http_engine::initialize()
+{
+	if (!own3d::util::http_engine::_instance)
+		own3d::util::http_engine::_instance = std::make_shared<own3d::util::http_engine>();
+}
+
+void own3d::util::http_engine::finalize()
+{
+	own3d::util::http_engine::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::http_engine> own3d::util::http_engine::instance()
+{
+	return own3d::util::http_engine::_instance;
+}
@@ -0,0 +1,115 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "curl.hpp"
+
+namespace own3d::util {
+	typedef std::function<void(CURLcode)> http_engine_callback_t;
+
+	/** Asynchronous transfer engine built on top of curl_multi.
+	 *
+	 * A single worker thread drives all submitted transfers concurrently and
+	 * completes them through callbacks or futures. Callbacks are invoked on the
+	 * worker thread, so they should hand off any heavy work.
+	 */
+	class http_engine {
+		struct task {
+			std::shared_ptr<util::curl> handle;
+			http_engine_callback_t      callback;
+		};
+
+		CURLM*                  _multi;
+		std::thread             _worker;
+		std::mutex              _lock;
+		std::condition_variable _cv;
+		bool                    _shutdown;
+		size_t                  _max_transfers;
+
+		std::list<std::shared_ptr<task>>                                            _pending;
+		std::multimap<std::chrono::steady_clock::time_point, std::shared_ptr<task>> _delayed;
+		std::list<util::curl*>                                                      _cancel;
+		std::map<CURL*, std::shared_ptr<task>>                                      _active;
+
+		void runner();
+
+		/** Invoke the callback of a task, which must not hold the lock. */
+		void complete(std::shared_ptr<task> const& item, CURLcode res);
+
+		void wakeup();
+
+		public:
+		~http_engine();
+		http_engine();
+
+		/** Queue a transfer and invoke the callback once it completes.
+		 *
+		 * The engine keeps the handle alive until the callback has returned. The callback is
+		 * always invoked on the worker thread, also for requests answered from the HTTP cache.
+		 */
+		void submit(std::shared_ptr<util::curl> handle, http_engine_callback_t callback);
+
+		/** Queue a transfer and return a future for its result. */
+		std::future<CURLcode> submit(std::shared_ptr<util::curl> handle);
+
+		/** Queue a transfer to start once the delay has passed, for example to back off after a failure. */
+		void schedule(std::chrono::milliseconds delay, std::shared_ptr<util::curl> handle,
+					  http_engine_callback_t callback);
+
+		/** Remove a transfer from the engine without invoking its callback.
+		 *
+		 * Once this returns, the callback for the handle is guaranteed to either have
+		 * completed already or never be called.
+		 */
+		void cancel(std::shared_ptr<util::curl> handle);
+
+		/** Resolve the host of the URL and open a connection to it in the background.
+		 *
+		 * The connection stays idle in the shared connection cache, so that the next request
+		 * to the host skips DNS, TCP and TLS setup. Neither the circuit breaker nor the network
+		 * statistics count it, as its outcome says nothing about the endpoint.
+		 * @return The handle of the request, which may be passed to cancel().
+		 */
+		std::shared_ptr<util::curl> prewarm(std::string_view url);
+
+		/** Limit how many transfers may be active at the same time. */
+		void set_max_transfers(size_t limit);
+
+		/** Number of connections to a single host, transfers beyond it wait for a free connection. */
+		size_t get_max_host_transfers();
+
+		bool is_worker_thread();
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::http_engine> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::http_engine> instance();
+	};
+} // namespace own3d::util
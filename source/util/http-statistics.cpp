@@ -0,0 +1,164 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "http-statistics.hpp"
+#include <algorithm>
+#include "plugin.hpp"
+#include "retry.hpp"
+
+// Buckets per doubling of the value, which gives a resolution of about 9%.
+constexpr size_t HISTOGRAM_STEPS = 8;
+
+// How often a summary of all endpoints is written to the log.
+constexpr auto STATISTICS_LOG_INTERVAL = std::chrono::minutes(15);
+
+static size_t histogram_bucket(uint64_t value)
+{
+	if (value == 0)
+		return 0;
+	return static_cast<size_t>(std::log2(static_cast<double_t>(value)) * HISTOGRAM_STEPS) + 1;
+}
+
+static uint64_t histogram_value(size_t bucket)
+{
+	if (bucket == 0)
+		return 0;
+	// Report the middle of the bucket.
+	return static_cast<uint64_t>(std::exp2((static_cast<double_t>(bucket) - 0.5) / HISTOGRAM_STEPS));
+}
+
+own3d::util::histogram::histogram() : _buckets(), _count(0), _min(0), _max(0) {}
+
+void own3d::util::histogram::add(uint64_t value)
+{
+	_buckets[std::min(histogram_bucket(value), _buckets.size() - 1)]++;
+	_min = (_count == 0) ? value : std::min(_min, value);
+	_max = (_count == 0) ? value : std::max(_max, value);
+	_count++;
+}
+
+uint64_t own3d::util::histogram::count() const
+{
+	return _count;
+}
+
+uint64_t own3d::util::histogram::percentile(double_t fraction) const
+{
+	if (_count == 0)
+		return 0;
+
+	uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0., 1.) * _count));
+	uint64_t seen = 0;
+	for (size_t idx = 0; idx < _buckets.size(); idx++) {
+		seen += _buckets[idx];
+		if ((seen >= rank) && (seen > 0)) {
+			return std::clamp(histogram_value(idx), _min, _max);
+		}
+	}
+	return _max;
+}
+
+own3d::util::http_statistics::~http_statistics()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	log_summary();
+}
+
+own3d::util::http_statistics::http_statistics()
+	: _lock(), _endpoints(), _last_log(std::chrono::steady_clock::now())
+{}
+
+void own3d::util::http_statistics::log_summary()
+{
+	_last_log = std::chrono::steady_clock::now();
+
+	auto ms = [](histogram const& h, double_t fraction) {
+		return static_cast<double_t>(h.percentile(fraction)) / 1000.;
+	};
+	for (auto const& kv : _endpoints) {
+		auto const& st = kv.second;
+		DLOG_INFO("Network statistics for '%s': %llu requests, %llu failed, %llu on reused connections, %llu KiB.",
+				  kv.first.c_str(), st.requests, st.failures, st.reused, st.bytes / 1024);
+		DLOG_INFO("  p50/p95/p99 in ms: Total %.1f/%.1f/%.1f, DNS %.1f/%.1f/%.1f, Connect %.1f/%.1f/%.1f, "
+				  "TLS %.1f/%.1f/%.1f, TTFB %.1f/%.1f/%.1f, Transfer %.1f/%.1f/%.1f",
+				  ms(st.total, .5), ms(st.total, .95), ms(st.total, .99), ms(st.dns, .5), ms(st.dns, .95),
+				  ms(st.dns, .99), ms(st.connect, .5), ms(st.connect, .95), ms(st.connect, .99), ms(st.tls, .5),
+				  ms(st.tls, .95), ms(st.tls, .99), ms(st.ttfb, .5), ms(st.ttfb, .95), ms(st.ttfb, .99),
+				  ms(st.transfer, .5), ms(st.transfer, .95), ms(st.transfer, .99));
+		DLOG_INFO("  p50/p95/p99 throughput in KiB/s: %llu/%llu/%llu", st.speed.percentile(.5) / 1024,
+				  st.speed.percentile(.95) / 1024, st.speed.percentile(.99) / 1024);
+	}
+}
+
+void own3d::util::http_statistics::record(std::string_view url, bool success, http_timing const& timing)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	auto&                        st = _endpoints[util::circuit_breaker::endpoint(url)];
+
+	st.requests++;
+	if (!success) {
+		st.failures++;
+	} else {
+		if (timing.reused)
+			st.reused++;
+		st.bytes += timing.bytes;
+		st.dns.add(static_cast<uint64_t>(std::max<int64_t>(timing.dns, 0)));
+		st.connect.add(static_cast<uint64_t>(std::max<int64_t>(timing.connect, 0)));
+		st.tls.add(static_cast<uint64_t>(std::max<int64_t>(timing.tls, 0)));
+		st.ttfb.add(static_cast<uint64_t>(std::max<int64_t>(timing.ttfb, 0)));
+		st.transfer.add(static_cast<uint64_t>(std::max<int64_t>(timing.transfer, 0)));
+		st.total.add(static_cast<uint64_t>(std::max<int64_t>(timing.total, 0)));
+		st.speed.add(timing.speed);
+	}
+
+	if ((std::chrono::steady_clock::now() - _last_log) >= STATISTICS_LOG_INTERVAL) {
+		log_summary();
+	}
+}
+
+std::map<std::string, own3d::util::http_endpoint_statistics> own3d::util::http_statistics::query()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	return _endpoints;
+}
+
+bool own3d::util::http_statistics::query(std::string_view url, http_endpoint_statistics& statistics)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	if (auto itr = _endpoints.find(util::circuit_breaker::endpoint(url)); itr != _endpoints.end()) {
+		statistics = itr->second;
+		return true;
+	}
+	return false;
+}
+
+std::shared_ptr<own3d::util::http_statistics> own3d::util::http_statistics::_instance = nullptr;
+
+void own3d::util::http_statistics::initialize()
+{
+	if (!own3d::util::http_statistics::_instance)
+		own3d::util::http_statistics::_instance = std::make_shared<own3d::util::http_statistics>();
+}
+
+void own3d::util::http_statistics::finalize()
+{
+	own3d::util::http_statistics::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::http_statistics> own3d::util::http_statistics::instance()
+{
+	return own3d::util::http_statistics::_instance;
+}
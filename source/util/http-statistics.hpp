@@ -0,0 +1,112 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace own3d::util {
+	/** Streaming histogram with logarithmic buckets, roughly 9% apart.
+	 *
+	 * Uses constant memory no matter how many values are added, at the cost of
+	 * percentiles only being accurate to the width of a bucket.
+	 */
+	class histogram {
+		std::array<uint64_t, 512> _buckets;
+		uint64_t                  _count;
+		uint64_t                  _min;
+		uint64_t                  _max;
+
+		public:
+		histogram();
+
+		void add(uint64_t value);
+
+		uint64_t count() const;
+
+		/** Estimate the value below which the given fraction (0..1) of all values lie. */
+		uint64_t percentile(double_t fraction) const;
+	};
+
+	/** Timings of a single transfer, split into its phases. All times are in microseconds. */
+	struct http_timing {
+		int64_t  dns      = 0; // Name lookup.
+		int64_t  connect  = 0; // TCP handshake.
+		int64_t  tls      = 0; // TLS handshake, 0 for plain HTTP or reused connections.
+		int64_t  ttfb     = 0; // From the request being sent to the first byte of the response.
+		int64_t  transfer = 0; // Receiving the response body.
+		int64_t  total    = 0;
+		uint64_t bytes    = 0;     // Bytes received.
+		uint64_t speed    = 0;     // Bytes per second.
+		bool     reused   = false; // No new connection had to be made.
+	};
+
+	/** Aggregated timings of all transfers to one endpoint. */
+	struct http_endpoint_statistics {
+		uint64_t  requests = 0;
+		uint64_t  failures = 0;
+		uint64_t  reused   = 0;
+		uint64_t  bytes    = 0;
+		histogram dns;
+		histogram connect;
+		histogram tls;
+		histogram ttfb;
+		histogram transfer;
+		histogram total;
+		histogram speed;
+	};
+
+	/** Collects timings of all transfers, and logs a summary every now and then. */
+	class http_statistics {
+		std::mutex                                      _lock;
+		std::map<std::string, http_endpoint_statistics> _endpoints;
+		std::chrono::steady_clock::time_point           _last_log;
+
+		void log_summary();
+
+		public:
+		~http_statistics();
+		http_statistics();
+
+		/** Record the outcome of a finished transfer. */
+		void record(std::string_view url, bool success, http_timing const& timing);
+
+		/** Get the statistics of all endpoints, keyed by circuit_breaker::endpoint(). */
+		std::map<std::string, http_endpoint_statistics> query();
+
+		/** Get the statistics of the endpoint the URL belongs to.
+		 * @return false if nothing was recorded for it yet.
+		 */
+		bool query(std::string_view url, http_endpoint_statistics& statistics);
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::http_statistics> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::http_statistics> instance();
+	};
+} // namespace own3d::util
@@ -0,0 +1,108 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "mmap.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+own3d::util::mapped_file::~mapped_file()
+{
+#ifdef _WIN32
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+#else
+	if (_data)
+		munmap(const_cast<uint8_t*>(_data), static_cast<size_t>(_size));
+#endif
+}
+
+own3d::util::mapped_file::mapped_file(std::filesystem::path const& path)
+	: _data(nullptr), _size(0)
+{
+#ifdef _WIN32
+	_mapping = nullptr;
+
+	HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+							  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Failed to open file for mapping.");
+
+	LARGE_INTEGER size = {};
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to open file for mapping.");
+	}
+	_size = static_cast<uint64_t>(size.QuadPart);
+
+	// Empty files can't be mapped, but there is nothing to read from them either.
+	if (_size > 0) {
+		_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping) {
+			_data = reinterpret_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+	// The mapping keeps the file open on its own.
+	CloseHandle(file);
+	if ((_size > 0) && !_data) {
+		if (_mapping)
+			CloseHandle(_mapping);
+		throw std::runtime_error("Failed to map file.");
+	}
+#else
+	int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		throw std::runtime_error("Failed to open file for mapping.");
+
+	struct stat info;
+	if (fstat(file, &info) != 0) {
+		close(file);
+		throw std::runtime_error("Failed to open file for mapping.");
+	}
+	_size = static_cast<uint64_t>(info.st_size);
+
+	// Empty files can't be mapped, but there is nothing to read from them either.
+	if (_size > 0) {
+		void* data = mmap(nullptr, static_cast<size_t>(_size), PROT_READ, MAP_SHARED, file, 0);
+		if (data == MAP_FAILED) {
+			close(file);
+			throw std::runtime_error("Failed to map file.");
+		}
+		_data = reinterpret_cast<const uint8_t*>(data);
+	}
+	// The mapping keeps the file open on its own.
+	close(file);
+#endif
+}
+
+const uint8_t* own3d::util::mapped_file::data()
+{
+	return _data;
+}
+
+uint64_t own3d::util::mapped_file::size()
+{
+	return _size;
+}
@@ -0,0 +1,41 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cinttypes>
+#include <filesystem>
+
+namespace own3d::util {
+	/** Read-only memory mapping of a whole file. */
+	class mapped_file {
+		const uint8_t* _data;
+		uint64_t       _size;
+#ifdef _WIN32
+		void* _mapping;
+#endif
+
+		public:
+		~mapped_file();
+		mapped_file(std::filesystem::path const& path);
+
+		mapped_file(mapped_file const&) = delete;
+		mapped_file& operator=(mapped_file const&) = delete;
+
+		const uint8_t* data();
+
+		uint64_t size();
+	};
+} // namespace own3d::util
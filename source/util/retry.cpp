@@ -0,0 +1,175 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "retry.hpp"
+#include <algorithm>
+#include "plugin.hpp"
+
+// Consecutive failures after which an endpoint is considered down.
+constexpr size_t CIRCUIT_BREAKER_THRESHOLD = 5;
+// How long requests to an endpoint that is down fail without being attempted.
+constexpr auto CIRCUIT_BREAKER_COOLDOWN = std::chrono::seconds(60);
+// Every route below this path is an endpoint of its own.
+constexpr std::string_view ENDPOINT_API_PATH = "/api/";
+
+bool own3d::util::is_retryable(CURLcode res, long response_code)
+{
+	switch (res) {
+	case CURLE_COULDNT_RESOLVE_HOST:
+	case CURLE_COULDNT_CONNECT:
+	case CURLE_OPERATION_TIMEDOUT:
+	case CURLE_PARTIAL_FILE:
+	case CURLE_RECV_ERROR:
+	case CURLE_SEND_ERROR:
+	case CURLE_GOT_NOTHING:
+	case CURLE_SSL_CONNECT_ERROR:
+	case CURLE_HTTP2:
+	case CURLE_HTTP2_STREAM:
+		return true;
+	case CURLE_OK:
+	case CURLE_HTTP_RETURNED_ERROR:
+		return (response_code >= 500) || (response_code == 408) || (response_code == 429);
+	default:
+		return false;
+	}
+}
+
+own3d::util::backoff::backoff(std::chrono::milliseconds initial, std::chrono::milliseconds maximum,
+							  std::chrono::milliseconds max_elapsed, size_t max_attempts)
+	: _initial(initial), _maximum(maximum), _max_elapsed(max_elapsed), _max_attempts(max_attempts),
+	  _start(std::chrono::steady_clock::now()), _attempt(0), _random(std::random_device{}())
+{}
+
+bool own3d::util::backoff::next(std::chrono::milliseconds& delay)
+{
+	if ((_max_attempts > 0) && (_attempt >= _max_attempts))
+		return false;
+
+	auto elapsed = std::chrono::steady_clock::now() - _start;
+	if ((_max_elapsed.count() > 0) && (elapsed >= _max_elapsed))
+		return false;
+
+	// Cap the exponent, the maximum is reached long before it could overflow.
+	auto cap = std::min<std::chrono::milliseconds>(_initial * (1ll << std::min<size_t>(_attempt, 30)), _maximum);
+	_attempt++;
+
+	std::uniform_int_distribution<int64_t> dist(0, cap.count());
+	delay = std::chrono::milliseconds(dist(_random));
+
+	// Don't sleep past the point at which we'd give up anyway.
+	if (_max_elapsed.count() > 0) {
+		delay = std::min<std::chrono::milliseconds>(
+			delay, std::chrono::duration_cast<std::chrono::milliseconds>(_max_elapsed - elapsed));
+	}
+	return true;
+}
+
+size_t own3d::util::backoff::attempts()
+{
+	return _attempt;
+}
+
+void own3d::util::backoff::reset()
+{
+	_attempt = 0;
+	_start   = std::chrono::steady_clock::now();
+}
+
+own3d::util::circuit_breaker::~circuit_breaker() {}
+
+own3d::util::circuit_breaker::circuit_breaker()
+	: _lock(), _endpoints(), _threshold(CIRCUIT_BREAKER_THRESHOLD), _cooldown(CIRCUIT_BREAKER_COOLDOWN)
+{}
+
+bool own3d::util::circuit_breaker::allow(std::string_view url)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	auto                         itr = _endpoints.find(endpoint(url));
+	if ((itr == _endpoints.end()) || !itr->second.open)
+		return true;
+
+	auto now = std::chrono::steady_clock::now();
+	if (now < itr->second.open_until)
+		return false;
+
+	// Let a single trial through. Should it never report back, another one follows after the next cool-down.
+	itr->second.open_until = now + _cooldown;
+	return true;
+}
+
+void own3d::util::circuit_breaker::report(std::string_view url, bool success)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	auto                         key = endpoint(url);
+
+	if (success) {
+		if (auto itr = _endpoints.find(key); itr != _endpoints.end()) {
+			if (itr->second.open) {
+				DLOG_INFO("Endpoint '%s' recovered.", key.c_str());
+			}
+			_endpoints.erase(itr);
+		}
+		return;
+	}
+
+	auto& state = _endpoints[key];
+	state.failures++;
+	if (!state.open && (state.failures >= _threshold)) {
+		DLOG_WARNING("Endpoint '%s' failed %zu times in a row, pausing requests to it.", key.c_str(), state.failures);
+		state.open = true;
+	}
+	if (state.open) {
+		state.open_until = std::chrono::steady_clock::now() + _cooldown;
+	}
+}
+
+std::string own3d::util::circuit_breaker::endpoint(std::string_view url)
+{
+	url = url.substr(0, url.find_first_of("?#"));
+
+	size_t host = url.find("://");
+	host        = (host == std::string_view::npos) ? 0 : (host + 3);
+	size_t path = url.find('/', host);
+	if (path == std::string_view::npos)
+		return std::string(url);
+
+	// API routes fail and perform independently of each other, so they keep their whole path.
+	if (url.substr(path, ENDPOINT_API_PATH.length()) == ENDPOINT_API_PATH)
+		return std::string(url);
+
+	// Anything else is a file, such as a theme pack. Files share the scheme, host and first directory, so that
+	// every single one doesn't get its own entry.
+	size_t directory = url.find('/', path + 1);
+	return std::string(url.substr(0, (directory == std::string_view::npos) ? path : directory));
+}
+
+std::shared_ptr<own3d::util::circuit_breaker> own3d::util::circuit_breaker::_instance = nullptr;
+
+void own3d::util::circuit_breaker::initialize()
+{
+	if (!own3d::util::circuit_breaker::_instance)
+		own3d::util::circuit_breaker::_instance = std::make_shared<own3d::util::circuit_breaker>();
+}
+
+void own3d::util::circuit_breaker::finalize()
+{
+	own3d::util::circuit_breaker::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::circuit_breaker> own3d::util::circuit_breaker::instance()
+{
+	return own3d::util::circuit_breaker::_instance;
+}
@@ -0,0 +1,116 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <chrono>
+#include <cinttypes>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+
+extern "C" {
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <curl/curl.h>
+}
+
+namespace own3d::util {
+	/** Check if a failed request may succeed when it is tried again later. */
+	bool is_retryable(CURLcode res, long response_code);
+
+	/** Exponential backoff with full jitter.
+	 *
+	 * Each delay is picked at random between zero and the exponentially growing cap,
+	 * so that clients which failed at the same time don't retry in lock-step.
+	 */
+	class backoff {
+		std::chrono::milliseconds             _initial;
+		std::chrono::milliseconds             _maximum;
+		std::chrono::milliseconds             _max_elapsed;
+		size_t                                _max_attempts;
+		std::chrono::steady_clock::time_point _start;
+		size_t                                _attempt;
+		std::mt19937_64                       _random;
+
+		public:
+		/**
+		 * @param max_elapsed Give up once this much time passed since the first attempt, 0 for never.
+		 * @param max_attempts Give up after this many retries, 0 for never.
+		 */
+		backoff(std::chrono::milliseconds initial, std::chrono::milliseconds maximum,
+				std::chrono::milliseconds max_elapsed = std::chrono::milliseconds(0), size_t max_attempts = 0);
+
+		/** Calculate the delay before the next attempt.
+		 * @return false if no further attempts should be made.
+		 */
+		bool next(std::chrono::milliseconds& delay);
+
+		/** Number of retries so far. */
+		size_t attempts();
+
+		/** Start over, for example after progress was made. */
+		void reset();
+	};
+
+	/** Fails requests fast while an endpoint is known to be down.
+	 *
+	 * After a number of consecutive failures the endpoint is considered down for a
+	 * cool-down period. Once that has passed a single trial request is let through,
+	 * and its outcome decides whether the endpoint is back up or stays down.
+	 */
+	class circuit_breaker {
+		struct state {
+			size_t                                failures = 0;
+			bool                                  open     = false;
+			std::chrono::steady_clock::time_point open_until;
+		};
+
+		std::mutex                   _lock;
+		std::map<std::string, state> _endpoints;
+		size_t                       _threshold;
+		std::chrono::milliseconds    _cooldown;
+
+		public:
+		~circuit_breaker();
+		circuit_breaker();
+
+		/** Check if a request to the URL may be made right now. */
+		bool allow(std::string_view url);
+
+		/** Record the outcome of a request to the URL. */
+		void report(std::string_view url, bool success);
+
+		/** Reduce a URL to the endpoint it is tracked as.
+		 *
+		 * API routes are tracked by their path without query. Files are grouped by scheme, host and first directory.
+		 */
+		static std::string endpoint(std::string_view url);
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::circuit_breaker> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::circuit_breaker> instance();
+	};
+} // namespace own3d::util
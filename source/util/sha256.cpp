@@ -0,0 +1,203 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "sha256.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// Size of the blocks in which files are read.
+constexpr size_t SHA256_READ_SIZE = 1024 * 1024;
+
+static constexpr uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t v, uint32_t n)
+{
+	return (v >> n) | (v << (32 - n));
+}
+
+own3d::util::sha256::~sha256() {}
+
+own3d::util::sha256::sha256() : _state(), _length(0), _buffer(), _buffered(0)
+{
+	reset();
+}
+
+void own3d::util::sha256::reset()
+{
+	static constexpr uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+											0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+	memcpy(_state, initial, sizeof(_state));
+	_length   = 0;
+	_buffered = 0;
+}
+
+void own3d::util::sha256::transform(const uint8_t* block)
+{
+	uint32_t w[64];
+	for (size_t idx = 0; idx < 16; idx++) {
+		w[idx] = (uint32_t(block[idx * 4]) << 24) | (uint32_t(block[idx * 4 + 1]) << 16)
+				 | (uint32_t(block[idx * 4 + 2]) << 8) | uint32_t(block[idx * 4 + 3]);
+	}
+	for (size_t idx = 16; idx < 64; idx++) {
+		uint32_t s0 = rotr(w[idx - 15], 7) ^ rotr(w[idx - 15], 18) ^ (w[idx - 15] >> 3);
+		uint32_t s1 = rotr(w[idx - 2], 17) ^ rotr(w[idx - 2], 19) ^ (w[idx - 2] >> 10);
+		w[idx]      = w[idx - 16] + s0 + w[idx - 7] + s1;
+	}
+
+	uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+	uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+	for (size_t idx = 0; idx < 64; idx++) {
+		uint32_t s1  = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		uint32_t ch  = (e & f) ^ (~e & g);
+		uint32_t t1  = h + s1 + ch + SHA256_K[idx] + w[idx];
+		uint32_t s0  = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2  = s0 + maj;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	_state[0] += a;
+	_state[1] += b;
+	_state[2] += c;
+	_state[3] += d;
+	_state[4] += e;
+	_state[5] += f;
+	_state[6] += g;
+	_state[7] += h;
+}
+
+void own3d::util::sha256::update(const void* data, size_t length)
+{
+	auto ptr = reinterpret_cast<const uint8_t*>(data);
+	_length += length;
+
+	// Complete a partially filled block first.
+	if (_buffered > 0) {
+		size_t count = std::min<size_t>(sizeof(_buffer) - _buffered, length);
+		memcpy(_buffer + _buffered, ptr, count);
+		_buffered += count;
+		ptr += count;
+		length -= count;
+		if (_buffered < sizeof(_buffer))
+			return;
+		transform(_buffer);
+		_buffered = 0;
+	}
+
+	// Then hash whole blocks directly from the input.
+	for (; length >= sizeof(_buffer); ptr += sizeof(_buffer), length -= sizeof(_buffer)) {
+		transform(ptr);
+	}
+
+	memcpy(_buffer, ptr, length);
+	_buffered = length;
+}
+
+own3d::util::sha256::digest_t own3d::util::sha256::finalize()
+{
+	uint64_t bits = _length * 8;
+
+	uint8_t padding[sizeof(_buffer) + 8] = {0x80};
+	size_t  count = ((_buffered < 56) ? 56 : 120) - _buffered;
+	for (size_t idx = 0; idx < 8; idx++) {
+		padding[count + idx] = static_cast<uint8_t>(bits >> (56 - idx * 8));
+	}
+	update(padding, count + 8);
+
+	digest_t digest;
+	for (size_t idx = 0; idx < 8; idx++) {
+		digest[idx * 4]     = static_cast<uint8_t>(_state[idx] >> 24);
+		digest[idx * 4 + 1] = static_cast<uint8_t>(_state[idx] >> 16);
+		digest[idx * 4 + 2] = static_cast<uint8_t>(_state[idx] >> 8);
+		digest[idx * 4 + 3] = static_cast<uint8_t>(_state[idx]);
+	}
+	return digest;
+}
+
+bool own3d::util::sha256::update_file(std::filesystem::path const& path, uint64_t offset, uint64_t length)
+{
+	std::ifstream stream{path, std::ios::binary | std::ios::in};
+	if (!stream.good())
+		return false;
+	stream.seekg(static_cast<std::streamoff>(offset));
+
+	std::vector<char> buffer(SHA256_READ_SIZE);
+	bool              to_end = (length == 0);
+	while (to_end || (length > 0)) {
+		size_t count = to_end ? buffer.size() : static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+		stream.read(buffer.data(), static_cast<std::streamsize>(count));
+		size_t read = static_cast<size_t>(stream.gcount());
+		update(buffer.data(), read);
+		if (read < count)
+			return to_end && stream.eof();
+		length -= to_end ? 0 : read;
+	}
+	return true;
+}
+
+std::string own3d::util::sha256::to_string(digest_t const& digest)
+{
+	constexpr char hex[] = "0123456789abcdef";
+	std::string    text;
+	text.reserve(digest.size() * 2);
+	for (uint8_t v : digest) {
+		text.push_back(hex[v >> 4]);
+		text.push_back(hex[v & 0xF]);
+	}
+	return text;
+}
+
+bool own3d::util::sha256::from_string(std::string_view text, digest_t& digest)
+{
+	if (text.length() != (digest.size() * 2))
+		return false;
+
+	auto nibble = [](char v) {
+		if ((v >= '0') && (v <= '9'))
+			return v - '0';
+		if ((v >= 'a') && (v <= 'f'))
+			return v - 'a' + 10;
+		if ((v >= 'A') && (v <= 'F'))
+			return v - 'A' + 10;
+		return -1;
+	};
+	for (size_t idx = 0; idx < digest.size(); idx++) {
+		int hi = nibble(text[idx * 2]), lo = nibble(text[idx * 2 + 1]);
+		if ((hi < 0) || (lo < 0))
+			return false;
+		digest[idx] = static_cast<uint8_t>((hi << 4) | lo);
+	}
+	return true;
+}
@@ -0,0 +1,61 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <array>
+#include <cinttypes>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace own3d::util {
+	/** Incremental SHA-256, so that data can be hashed while it streams past. */
+	class sha256 {
+		public:
+		typedef std::array<uint8_t, 32> digest_t;
+
+		private:
+		uint32_t _state[8];
+		uint64_t _length;
+		uint8_t  _buffer[64];
+		size_t   _buffered;
+
+		void transform(const uint8_t* block);
+
+		public:
+		~sha256();
+		sha256();
+
+		void reset();
+
+		void update(const void* data, size_t length);
+
+		/** Complete the hash. The object must be reset before it can be used again. */
+		digest_t finalize();
+
+		/** Hash a range of a file, up to its end if length is 0.
+		 * @return false if the file couldn't be read completely.
+		 */
+		bool update_file(std::filesystem::path const& path, uint64_t offset, uint64_t length = 0);
+
+		static std::string to_string(digest_t const& digest);
+
+		/** Parse a digest in hexadecimal notation.
+		 * @return false if the text isn't exactly one digest.
+		 */
+		static bool from_string(std::string_view text, digest_t& digest);
+	};
+} // namespace own3d::util
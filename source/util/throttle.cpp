@@ -0,0 +1,95 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "throttle.hpp"
+#include <algorithm>
+#include <cmath>
+
+// How much unused bandwidth may be saved up, in seconds worth of the rate.
+constexpr double_t THROTTLE_BURST = 0.25;
+
+own3d::util::throttle::~throttle() {}
+
+own3d::util::throttle::throttle() : _lock(), _limit(0), _tokens(0), _updated(std::chrono::steady_clock::now()) {}
+
+void own3d::util::throttle::refill()
+{
+	auto     now     = std::chrono::steady_clock::now();
+	double_t elapsed = std::chrono::duration<double_t>(now - _updated).count();
+	double_t rate    = static_cast<double_t>(_limit.load());
+	_tokens          = std::min(_tokens + elapsed * rate, rate * THROTTLE_BURST);
+	_updated         = now;
+}
+
+void own3d::util::throttle::set_limit(uint64_t bytes_per_second)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	if (_limit.load() == 0) {
+		// Start with an empty bucket, so that there is no burst right as the limit kicks in.
+		_tokens  = 0;
+		_updated = std::chrono::steady_clock::now();
+	} else {
+		// Account for the time spent at the previous rate.
+		refill();
+	}
+	_limit.store(bytes_per_second);
+}
+
+uint64_t own3d::util::throttle::get_limit()
+{
+	return _limit.load();
+}
+
+bool own3d::util::throttle::acquire(size_t bytes)
+{
+	if (_limit.load() == 0)
+		return true;
+
+	std::unique_lock<std::mutex> lock(_lock);
+	refill();
+	if (_tokens < 0)
+		return false;
+	_tokens -= static_cast<double_t>(bytes);
+	return true;
+}
+
+bool own3d::util::throttle::available()
+{
+	if (_limit.load() == 0)
+		return true;
+
+	std::unique_lock<std::mutex> lock(_lock);
+	refill();
+	return _tokens >= 0;
+}
+
+std::shared_ptr<own3d::util::throttle> own3d::util::throttle::_instance = nullptr;
+
+void own3d::util::throttle::initialize()
+{
+	if (!own3d::util::throttle::_instance)
+		own3d::util::throttle::_instance = std::make_shared<own3d::util::throttle>();
+}
+
+void own3d::util::throttle::finalize()
+{
+	own3d::util::throttle::_instance.reset();
+}
+
+std::shared_ptr<own3d::util::throttle> own3d::util::throttle::instance()
+{
+	return own3d::util::throttle::_instance;
+}
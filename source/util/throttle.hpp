@@ -0,0 +1,67 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+namespace own3d::util {
+	/** Token bucket shared by all throttled transfers.
+	 *
+	 * Tokens are bytes, and refill at the configured rate up to a burst of a fraction of
+	 * a second. A transfer may take tokens as long as the bucket isn't in debt, so that
+	 * chunks larger than the burst still make progress at the average rate.
+	 */
+	class throttle {
+		std::mutex                            _lock;
+		std::atomic_uint64_t                  _limit;
+		double_t                              _tokens;
+		std::chrono::steady_clock::time_point _updated;
+
+		void refill();
+
+		public:
+		~throttle();
+		throttle();
+
+		/** Set the rate in bytes per second, 0 for unlimited. */
+		void set_limit(uint64_t bytes_per_second);
+
+		uint64_t get_limit();
+
+		/** Take tokens for the given amount of data.
+		 * @return false if the transfer should pause until tokens are available again.
+		 */
+		bool acquire(size_t bytes);
+
+		/** Check if a paused transfer may continue. */
+		bool available();
+
+		// Singleton
+		private:
+		static std::shared_ptr<own3d::util::throttle> _instance;
+
+		public:
+		static void initialize();
+		static void finalize();
+
+		static std::shared_ptr<own3d::util::throttle> instance();
+	};
+} // namespace own3d::util
@@ -0,0 +1,289 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "zip-index.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+// Bump whenever the layout below changes, so that old indices are rebuilt.
+constexpr uint32_t INDEX_VERSION  = 1;
+constexpr char     INDEX_MAGIC[4] = {'O', '3', 'D', 'I'};
+
+// The index is read in place, so its layout is fixed and in the byte order of the machine that wrote it.
+struct index_header {
+	char     magic[4];
+	uint32_t version;
+	uint64_t archive_size;
+	int64_t  archive_mtime;
+	uint64_t count;
+	uint64_t names_size;
+};
+static_assert(sizeof(index_header) == 40, "index_header must not have padding");
+
+struct index_record {
+	uint64_t data_offset;
+	uint64_t compressed_size;
+	uint64_t size;
+	uint32_t crc;
+	uint16_t method;
+	uint16_t name_length;
+	uint64_t name_offset;
+};
+static_assert(sizeof(index_record) == 40, "index_record must not have padding");
+
+constexpr uint32_t ZIP_SIGNATURE_LOCAL_FILE        = 0x04034b50;
+constexpr uint32_t ZIP_SIGNATURE_CENTRAL_DIRECTORY = 0x02014b50;
+constexpr uint32_t ZIP_SIGNATURE_END_OF_DIRECTORY  = 0x06054b50;
+constexpr uint32_t ZIP_SIGNATURE_ZIP64_END         = 0x06064b50;
+constexpr uint32_t ZIP_SIGNATURE_ZIP64_END_LOCATOR = 0x07064b50;
+constexpr uint16_t ZIP_EXTRA_ZIP64                 = 0x0001;
+constexpr size_t   ZIP_LOCAL_FILE_SIZE             = 30;
+constexpr size_t   ZIP_CENTRAL_DIRECTORY_SIZE      = 46;
+constexpr size_t   ZIP_END_OF_DIRECTORY_SIZE       = 22;
+constexpr size_t   ZIP_ZIP64_END_SIZE              = 56;
+constexpr size_t   ZIP_ZIP64_END_LOCATOR_SIZE      = 20;
+constexpr size_t   ZIP_MAX_COMMENT_SIZE            = 65535;
+
+static int64_t modification_time(std::filesystem::path const& file)
+{
+	return static_cast<int64_t>(std::filesystem::last_write_time(file).time_since_epoch().count());
+}
+
+namespace {
+	/** Bounds-checked little endian reads from the mapped archive. */
+	class archive_reader {
+		const uint8_t* _data;
+		uint64_t       _size;
+
+		public:
+		archive_reader(const uint8_t* data, uint64_t size) : _data(data), _size(size) {}
+
+		void check(uint64_t offset, uint64_t length)
+		{
+			if ((offset > _size) || (length > (_size - offset)))
+				throw std::runtime_error("Archive is truncated.");
+		}
+
+		uint16_t u16(uint64_t offset)
+		{
+			check(offset, 2);
+			return static_cast<uint16_t>(_data[offset] | (_data[offset + 1] << 8));
+		}
+
+		uint32_t u32(uint64_t offset)
+		{
+			return uint32_t(u16(offset)) | (uint32_t(u16(offset + 2)) << 16);
+		}
+
+		uint64_t u64(uint64_t offset)
+		{
+			return uint64_t(u32(offset)) | (uint64_t(u32(offset + 4)) << 32);
+		}
+
+		std::string_view string(uint64_t offset, uint64_t length)
+		{
+			check(offset, length);
+			return std::string_view(reinterpret_cast<const char*>(_data + offset), static_cast<size_t>(length));
+		}
+	};
+} // namespace
+
+own3d::util::zip_index::~zip_index() {}
+
+own3d::util::zip_index::zip_index() : _file(), _entries() {}
+
+uint64_t own3d::util::zip_index::count()
+{
+	return _entries.size();
+}
+
+own3d::util::zip_index::entry const& own3d::util::zip_index::at(uint64_t index)
+{
+	return _entries.at(static_cast<size_t>(index));
+}
+
+bool own3d::util::zip_index::find(std::string_view name, uint64_t& index)
+{
+	for (size_t idx = 0; idx < _entries.size(); idx++) {
+		if (_entries[idx].name == name) {
+			index = idx;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::filesystem::path own3d::util::zip_index::index_path(std::filesystem::path archive)
+{
+	return archive.concat(".idx");
+}
+
+std::shared_ptr<own3d::util::zip_index> own3d::util::zip_index::load(std::filesystem::path const& archive)
+try {
+	auto path = index_path(archive);
+	if (!std::filesystem::exists(path))
+		return nullptr;
+
+	auto         file = std::make_shared<mapped_file>(path);
+	index_header header;
+	if (file->size() < sizeof(header))
+		return nullptr;
+	memcpy(&header, file->data(), sizeof(header));
+
+	// Anything that changed the archive also changed its size or modification time.
+	if ((memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) || (header.version != INDEX_VERSION)
+		|| (header.archive_size != std::filesystem::file_size(archive))
+		|| (header.archive_mtime != modification_time(archive))) {
+		return nullptr;
+	}
+
+	uint64_t records = sizeof(index_header) + header.count * sizeof(index_record);
+	if ((header.count > (file->size() / sizeof(index_record))) || ((records + header.names_size) != file->size()))
+		return nullptr;
+
+	auto index = std::make_shared<zip_index>();
+	auto names = reinterpret_cast<const char*>(file->data() + records);
+	index->_entries.reserve(static_cast<size_t>(header.count));
+	for (uint64_t idx = 0; idx < header.count; idx++) {
+		index_record record;
+		memcpy(&record, file->data() + sizeof(index_header) + idx * sizeof(index_record), sizeof(record));
+		if ((record.name_offset > header.names_size) || (record.name_length > (header.names_size - record.name_offset)))
+			return nullptr;
+
+		entry value;
+		value.data_offset     = record.data_offset;
+		value.compressed_size = record.compressed_size;
+		value.size            = record.size;
+		value.crc             = record.crc;
+		value.method          = record.method;
+		value.name            = std::string_view(names + record.name_offset, record.name_length);
+		index->_entries.push_back(value);
+	}
+	index->_file = file;
+	return index;
+} catch (...) {
+	return nullptr;
+}
+
+std::shared_ptr<own3d::util::zip_index> own3d::util::zip_index::create(std::filesystem::path const& archive)
+{
+	auto           file = std::make_shared<mapped_file>(archive);
+	archive_reader reader(file->data(), file->size());
+
+	// The end of central directory record is followed by a comment of unknown length, so search for it.
+	uint64_t end = file->size();
+	if (end < ZIP_END_OF_DIRECTORY_SIZE)
+		throw std::runtime_error("Archive is truncated.");
+	uint64_t eocd = end - ZIP_END_OF_DIRECTORY_SIZE;
+	for (uint64_t limit = (eocd > ZIP_MAX_COMMENT_SIZE) ? (eocd - ZIP_MAX_COMMENT_SIZE) : 0;
+		 reader.u32(eocd) != ZIP_SIGNATURE_END_OF_DIRECTORY; eocd--) {
+		if (eocd == limit)
+			throw std::runtime_error("Archive has no central directory.");
+	}
+
+	uint64_t count     = reader.u16(eocd + 10);
+	uint64_t cd_offset = reader.u32(eocd + 16);
+	if ((eocd >= ZIP_ZIP64_END_LOCATOR_SIZE)
+		&& (reader.u32(eocd - ZIP_ZIP64_END_LOCATOR_SIZE) == ZIP_SIGNATURE_ZIP64_END_LOCATOR)) {
+		uint64_t zip64 = reader.u64(eocd - ZIP_ZIP64_END_LOCATOR_SIZE + 8);
+		reader.check(zip64, ZIP_ZIP64_END_SIZE);
+		if (reader.u32(zip64) != ZIP_SIGNATURE_ZIP64_END)
+			throw std::runtime_error("Archive has a damaged zip64 central directory.");
+		count     = reader.u64(zip64 + 32);
+		cd_offset = reader.u64(zip64 + 48);
+	}
+
+	// Gather everything first, so that the names can be laid out after the records.
+	std::vector<index_record> records;
+	std::string               names;
+	uint64_t                  offset = cd_offset;
+	for (uint64_t idx = 0; idx < count; idx++) {
+		if (reader.u32(offset) != ZIP_SIGNATURE_CENTRAL_DIRECTORY)
+			throw std::runtime_error("Archive has a damaged central directory.");
+
+		index_record record    = {};
+		record.method          = reader.u16(offset + 10);
+		record.crc             = reader.u32(offset + 16);
+		record.compressed_size = reader.u32(offset + 20);
+		record.size            = reader.u32(offset + 24);
+		uint16_t name_length   = reader.u16(offset + 28);
+		uint16_t extra_length  = reader.u16(offset + 30);
+		uint16_t comment       = reader.u16(offset + 32);
+		uint64_t local         = reader.u32(offset + 42);
+		auto     name          = reader.string(offset + ZIP_CENTRAL_DIRECTORY_SIZE, name_length);
+
+		// Only the values that didn't fit into the record are in the zip64 extra field, in this order.
+		uint64_t extra = offset + ZIP_CENTRAL_DIRECTORY_SIZE + name_length;
+		for (uint64_t pos = extra; (pos + 4) <= (extra + extra_length);) {
+			uint16_t id     = reader.u16(pos);
+			uint16_t length = reader.u16(pos + 2);
+			if (id == ZIP_EXTRA_ZIP64) {
+				uint64_t field = pos + 4;
+				if (record.size == 0xFFFFFFFF) {
+					record.size = reader.u64(field);
+					field += 8;
+				}
+				if (record.compressed_size == 0xFFFFFFFF) {
+					record.compressed_size = reader.u64(field);
+					field += 8;
+				}
+				if (local == 0xFFFFFFFF) {
+					local = reader.u64(field);
+				}
+			}
+			pos += 4 + length;
+		}
+
+		// The local header may have a different extra field, so the data offset comes from it.
+		if (reader.u32(local) != ZIP_SIGNATURE_LOCAL_FILE)
+			throw std::runtime_error("Archive has a damaged local file header.");
+		record.data_offset = local + ZIP_LOCAL_FILE_SIZE + reader.u16(local + 26) + reader.u16(local + 28);
+		reader.check(record.data_offset, record.compressed_size);
+
+		record.name_length = name_length;
+		record.name_offset = names.size();
+		names.append(name);
+		records.push_back(record);
+
+		offset += ZIP_CENTRAL_DIRECTORY_SIZE + name_length + extra_length + comment;
+	}
+
+	index_header header;
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version       = INDEX_VERSION;
+	header.archive_size  = file->size();
+	header.archive_mtime = modification_time(archive);
+	header.count         = records.size();
+	header.names_size    = names.size();
+
+	// Write to a temporary file first, so that a crash can't leave a damaged index behind.
+	auto path      = index_path(archive);
+	auto temporary = std::filesystem::path(path).concat(".tmp");
+	{
+		std::ofstream stream{temporary, std::ios::binary | std::ios::trunc | std::ios::out};
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		stream.write(reinterpret_cast<const char*>(records.data()),
+					 static_cast<std::streamsize>(records.size() * sizeof(index_record)));
+		stream.write(names.data(), static_cast<std::streamsize>(names.size()));
+		if (!stream.good())
+			throw std::runtime_error("Failed to write archive index.");
+	}
+	std::filesystem::rename(temporary, path);
+
+	return load(archive);
+}
@@ -0,0 +1,68 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cinttypes>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "mmap.hpp"
+
+namespace own3d::util {
+	/** Persistent index of the entries of an archive, stored next to it as "<archive>.idx".
+	 *
+	 * The index is built from the central directory once the archive was opened and checked
+	 * successfully, and is only used again while the archive has the same size and modification
+	 * time. The names are read straight from the mapped index file.
+	 */
+	class zip_index {
+		public:
+		struct entry {
+			uint64_t         data_offset; // Offset of the (compressed) data in the archive.
+			uint64_t         compressed_size;
+			uint64_t         size;
+			uint32_t         crc;
+			uint16_t         method;
+			std::string_view name;
+		};
+
+		private:
+		std::shared_ptr<mapped_file> _file;
+		std::vector<entry>           _entries;
+
+		public:
+		~zip_index();
+		zip_index();
+
+		uint64_t count();
+
+		entry const& at(uint64_t index);
+
+		/** Find an entry by its name.
+		 * @return false if there is no such entry.
+		 */
+		bool find(std::string_view name, uint64_t& index);
+
+		/** Load the index of the archive, if there is one that is still up to date. */
+		static std::shared_ptr<zip_index> load(std::filesystem::path const& archive);
+
+		/** Build the index from the central directory of the archive, and store it. */
+		static std::shared_ptr<zip_index> create(std::filesystem::path const& archive);
+
+		static std::filesystem::path index_path(std::filesystem::path archive);
+	};
+} // namespace own3d::util
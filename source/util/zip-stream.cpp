@@ -0,0 +1,516 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "zip-stream.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "blob-store.hpp"
+#include "plugin.hpp"
+
+extern "C" {
+#include <zlib.h>
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+}
+
+// Size of the blocks in which the archive is read and entries are written.
+constexpr size_t STREAM_BUFFER_SIZE = 256 * 1024;
+// How often wait() reports progress.
+constexpr auto STREAM_PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+constexpr uint32_t ZIP_SIGNATURE_LOCAL_FILE        = 0x04034b50;
+constexpr uint32_t ZIP_SIGNATURE_DATA_DESCRIPTOR   = 0x08074b50;
+constexpr uint32_t ZIP_SIGNATURE_CENTRAL_DIRECTORY = 0x02014b50;
+constexpr uint32_t ZIP_SIGNATURE_END_OF_DIRECTORY  = 0x06054b50;
+constexpr uint16_t ZIP_EXTRA_ZIP64                 = 0x0001;
+constexpr uint16_t ZIP_FLAG_ENCRYPTED              = 0x0001;
+constexpr uint16_t ZIP_FLAG_DATA_DESCRIPTOR        = 0x0008;
+constexpr uint16_t ZIP_FLAG_UTF8                   = 0x0800;
+constexpr uint16_t ZIP_METHOD_STORE                = 0;
+constexpr uint16_t ZIP_METHOD_DEFLATE              = 8;
+constexpr uint16_t ZIP_METHOD_ZSTD                 = 93;
+
+namespace {
+	/** Buffered sequential reader over the part of the file that is available. */
+	class stream_reader {
+		own3d::util::zip_stream* _parent;
+		std::filesystem::path    _path;
+		std::ifstream            _file;
+		std::vector<char>        _buffer;
+		size_t                   _begin;
+		size_t                   _end;
+		uint64_t                 _offset; // Position in the file at which the buffer ends.
+
+		public:
+		stream_reader(own3d::util::zip_stream* parent, std::filesystem::path const& path)
+			: _parent(parent), _path(path), _file(), _buffer(STREAM_BUFFER_SIZE), _begin(0), _end(0), _offset(0)
+		{}
+
+		/** Read from the file into the buffer, once it is available that far. */
+		bool load(size_t position, size_t space)
+		{
+			uint64_t available = _parent->wait_available(_offset);
+			if (available <= _offset)
+				return false;
+
+			// The file may not exist until the first data has arrived.
+			if (!_file.is_open()) {
+				_file.open(_path, std::ios::binary | std::ios::in);
+				if (!_file.is_open())
+					throw std::runtime_error("Failed to open file.");
+			}
+
+			// The file keeps growing behind our back, so clear the end of file state every time.
+			size_t length = static_cast<size_t>(std::min<uint64_t>(available - _offset, space));
+			_file.clear();
+			_file.seekg(static_cast<std::streamoff>(_offset));
+			_file.read(_buffer.data() + position, static_cast<std::streamsize>(length));
+			if (static_cast<size_t>(_file.gcount()) != length)
+				throw std::runtime_error("Failed to read file.");
+
+			_end = position + length;
+			_offset += length;
+			return true;
+		}
+
+		/** Make sure at least one byte is buffered.
+		 * @return false if the end of the available data was reached.
+		 */
+		bool fill()
+		{
+			if (_begin < _end)
+				return true;
+
+			_begin = 0;
+			_end   = 0;
+			return load(0, _buffer.size());
+		}
+
+		const char* data()
+		{
+			return _buffer.data() + _begin;
+		}
+
+		size_t size()
+		{
+			return _end - _begin;
+		}
+
+		void consume(size_t length)
+		{
+			_begin += length;
+		}
+
+		/** Position in the file of the next byte to be read. */
+		uint64_t position()
+		{
+			return _offset - (_end - _begin);
+		}
+
+		void read(void* data, size_t length)
+		{
+			auto ptr = reinterpret_cast<char*>(data);
+			while (length > 0) {
+				if (!fill())
+					throw std::runtime_error("Unexpected end of archive.");
+				size_t count = std::min(length, size());
+				memcpy(ptr, this->data(), count);
+				consume(count);
+				ptr += count;
+				length -= count;
+			}
+		}
+
+		uint16_t read_u16()
+		{
+			uint8_t v[2];
+			read(v, sizeof(v));
+			return static_cast<uint16_t>(v[0] | (v[1] << 8));
+		}
+
+		uint32_t read_u32()
+		{
+			uint8_t v[4];
+			read(v, sizeof(v));
+			return uint32_t(v[0]) | (uint32_t(v[1]) << 8) | (uint32_t(v[2]) << 16) | (uint32_t(v[3]) << 24);
+		}
+
+		uint64_t read_u64()
+		{
+			uint64_t low = read_u32();
+			return low | (uint64_t(read_u32()) << 32);
+		}
+
+		/** Check the next four bytes without consuming them. */
+		bool peek_u32(uint32_t& value)
+		{
+			while (size() < 4) {
+				// Move the rest to the front, and append to it.
+				memmove(_buffer.data(), data(), size());
+				_end -= _begin;
+				_begin = 0;
+				if (!load(_end, _buffer.size() - _end))
+					return false;
+			}
+			auto v = reinterpret_cast<const uint8_t*>(data());
+			value  = uint32_t(v[0]) | (uint32_t(v[1]) << 8) | (uint32_t(v[2]) << 16) | (uint32_t(v[3]) << 24);
+			return true;
+		}
+	};
+} // namespace
+
+own3d::util::zip_stream::~zip_stream()
+{
+	abort();
+	if (_worker.joinable())
+		_worker.join();
+
+	// Anything still staged was not committed, and must not be used.
+	std::error_code ec;
+	std::filesystem::remove_all(_stage_path, ec);
+}
+
+own3d::util::zip_stream::zip_stream(std::filesystem::path path, std::filesystem::path output_path)
+	: _file_path(path), _out_path(output_path), _stage_path(std::filesystem::path(output_path).concat(".staging")),
+	  _manifest(output_path), _lock(), _cv(), _available(0), _finished(false), _aborted(false), _done(false),
+	  _success(false), _files(0), _position(0), _worker()
+{
+	// Left overs of an earlier attempt were never verified.
+	std::error_code ec;
+	std::filesystem::remove_all(_stage_path, ec);
+
+	_worker = std::thread([this]() { run(); });
+}
+
+void own3d::util::zip_stream::advance(uint64_t offset)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	if (offset < _available) {
+		// Whatever was extracted so far may no longer match the file.
+		_aborted = true;
+	} else {
+		_available = offset;
+	}
+	_cv.notify_all();
+}
+
+uint64_t own3d::util::zip_stream::wait_available(uint64_t position)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_cv.wait(lock, [this, position]() { return _aborted || _finished || (_available > position); });
+	if (_aborted)
+		throw std::runtime_error("Aborted.");
+	return std::max(_available, position);
+}
+
+void own3d::util::zip_stream::finish()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_finished = true;
+	_cv.notify_all();
+}
+
+void own3d::util::zip_stream::abort()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_aborted = true;
+	_cv.notify_all();
+}
+
+bool own3d::util::zip_stream::wait(std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> callback)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	while (!_cv.wait_for(lock, STREAM_PROGRESS_INTERVAL, [this]() { return _done; })) {
+		uint64_t available = _available;
+		lock.unlock();
+		callback(_files, 0, _position, available);
+		lock.lock();
+	}
+	return _success;
+}
+
+uint64_t own3d::util::zip_stream::files()
+{
+	return _files;
+}
+
+void own3d::util::zip_stream::commit()
+{
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		if (!_done || !_success)
+			throw std::runtime_error("Extraction is not complete.");
+	}
+
+	// Renaming keeps the modification time, so the manifest stays valid for the files in their new place.
+	for (auto const& entry : std::filesystem::recursive_directory_iterator(_stage_path)) {
+		auto target = std::filesystem::path(_out_path) / std::filesystem::relative(entry.path(), _stage_path);
+		if (entry.is_directory()) {
+			std::filesystem::create_directories(target);
+		} else {
+			std::filesystem::create_directories(target.parent_path());
+			std::filesystem::rename(entry.path(), target);
+		}
+	}
+	std::filesystem::remove_all(_stage_path);
+
+	_manifest.save();
+}
+
+void own3d::util::zip_stream::run()
+{
+	bool success = false;
+	try {
+		stream_reader     reader(this, _file_path);
+		std::vector<char> buffer(STREAM_BUFFER_SIZE);
+
+		while (true) {
+			uint32_t signature = reader.read_u32();
+			if ((signature == ZIP_SIGNATURE_CENTRAL_DIRECTORY) || (signature == ZIP_SIGNATURE_END_OF_DIRECTORY)) {
+				// All entries come before the central directory.
+				success = true;
+				break;
+			} else if (signature != ZIP_SIGNATURE_LOCAL_FILE) {
+				throw std::runtime_error("Unexpected data in archive.");
+			}
+
+			reader.read_u16(); // Version needed to extract.
+			uint16_t flags            = reader.read_u16();
+			uint16_t method           = reader.read_u16();
+			reader.read_u32(); // Modification time and date.
+			uint32_t crc               = reader.read_u32();
+			uint64_t compressed_size   = reader.read_u32();
+			uint64_t uncompressed_size = reader.read_u32();
+			uint16_t name_length       = reader.read_u16();
+			uint16_t extra_length      = reader.read_u16();
+
+			std::string name(name_length, '\0');
+			reader.read(name.data(), name.size());
+
+			std::vector<uint8_t> extra(extra_length);
+			reader.read(extra.data(), extra.size());
+
+			bool zip64 = false;
+			for (size_t idx = 0; (idx + 4) <= extra.size();) {
+				uint16_t id     = static_cast<uint16_t>(extra[idx] | (extra[idx + 1] << 8));
+				size_t   length = std::min<size_t>(extra[idx + 2] | (extra[idx + 3] << 8), extra.size() - idx - 4);
+				idx += 4;
+
+				if (id == ZIP_EXTRA_ZIP64) {
+					// Only the values that didn't fit into the header are present, in this order.
+					zip64      = true;
+					size_t pos = idx;
+					auto   get = [&extra, &pos, end = idx + length](uint64_t& value) {
+						if ((pos + 8) <= end) {
+							value = 0;
+							for (size_t byte = 0; byte < 8; byte++) {
+								value |= uint64_t(extra[pos + byte]) << (byte * 8);
+							}
+							pos += 8;
+						}
+					};
+					if (uncompressed_size == 0xFFFFFFFF)
+						get(uncompressed_size);
+					if (compressed_size == 0xFFFFFFFF)
+						get(compressed_size);
+				}
+				idx += length;
+			}
+
+			if (flags & ZIP_FLAG_ENCRYPTED)
+				throw std::runtime_error("Encrypted entries are not supported.");
+#ifdef ENABLE_ZSTD
+			if ((method != ZIP_METHOD_STORE) && (method != ZIP_METHOD_DEFLATE) && (method != ZIP_METHOD_ZSTD))
+#else
+			if ((method != ZIP_METHOD_STORE) && (method != ZIP_METHOD_DEFLATE))
+#endif
+				throw std::runtime_error("Compression method is not supported.");
+			bool directory = (name.length() > 0) && (name.back() == '/');
+			if ((flags & ZIP_FLAG_DATA_DESCRIPTOR) && (method == ZIP_METHOD_STORE) && (compressed_size == 0)
+				&& !directory)
+				throw std::runtime_error("Stored entry of unknown size.");
+			if (!(flags & ZIP_FLAG_UTF8)) {
+				// libzip would guess the encoding of such names, so leave them to it.
+				for (char v : name) {
+					if (static_cast<uint8_t>(v) >= 0x80)
+						throw std::runtime_error("Entry name has an unknown encoding.");
+				}
+			}
+
+			// Build output file path, the same way util::zip does, and the path it is staged at.
+			std::filesystem::path filepath = _out_path;
+			filepath.append(name);
+			std::filesystem::path stagepath = _stage_path;
+			stagepath.append(name);
+			if (stagepath.has_parent_path()) {
+				std::filesystem::create_directories(stagepath.parent_path());
+			}
+
+			// Files that are still exactly what this entry would produce don't need to be written again.
+			if (!directory && !(flags & ZIP_FLAG_DATA_DESCRIPTOR) && (uncompressed_size > 0)
+				&& _manifest.unchanged(name, filepath, uncompressed_size, crc)) {
+				for (uint64_t skipped = 0; skipped < compressed_size;) {
+					if (!reader.fill())
+						throw std::runtime_error("Unexpected end of archive.");
+					size_t count = static_cast<size_t>(std::min<uint64_t>(compressed_size - skipped, reader.size()));
+					reader.consume(count);
+					skipped += count;
+				}
+				_files++;
+				_position = reader.position();
+				continue;
+			}
+
+			std::unique_ptr<blob_writer> stream;
+			if (!directory) {
+				stream = std::make_unique<blob_writer>(
+					stagepath, (flags & ZIP_FLAG_DATA_DESCRIPTOR) ? 0 : uncompressed_size);
+			}
+
+			uint32_t actual_crc          = crc32(0, nullptr, 0);
+			uint64_t actual_compressed   = 0;
+			uint64_t actual_uncompressed = 0;
+			auto     output              = [&](const char* data, size_t length) {
+				actual_crc = crc32(actual_crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(length));
+				actual_uncompressed += length;
+				if (length > 0) {
+					if (!stream)
+						throw std::runtime_error("Directory entry has data.");
+					stream->write(data, length);
+				}
+			};
+
+			if (method == ZIP_METHOD_STORE) {
+				while (actual_compressed < compressed_size) {
+					if (!reader.fill())
+						throw std::runtime_error("Unexpected end of archive.");
+					size_t count =
+						static_cast<size_t>(std::min<uint64_t>(compressed_size - actual_compressed, reader.size()));
+					output(reader.data(), count);
+					reader.consume(count);
+					actual_compressed += count;
+					_position = reader.position();
+				}
+#ifdef ENABLE_ZSTD
+			} else if (method == ZIP_METHOD_ZSTD) {
+				// Like deflate, zstd frames end on their own. An entry may consist of several frames though.
+				std::shared_ptr<ZSTD_DStream> zs(ZSTD_createDStream(), [](ZSTD_DStream* v) { ZSTD_freeDStream(v); });
+				if (!zs)
+					throw std::runtime_error("Failed to initialize zstd.");
+
+				bool descriptor = (flags & ZIP_FLAG_DATA_DESCRIPTOR) != 0;
+				for (size_t ret = 1; (ret != 0) || (!descriptor && (actual_compressed < compressed_size));) {
+					if (!reader.fill())
+						throw std::runtime_error("Unexpected end of archive.");
+					size_t input = reader.size();
+					if (!descriptor)
+						input = static_cast<size_t>(std::min<uint64_t>(compressed_size - actual_compressed, input));
+					if (input == 0)
+						throw std::runtime_error("Entry is damaged.");
+					ZSTD_inBuffer in = {reader.data(), input, 0};
+					do {
+						ZSTD_outBuffer out = {buffer.data(), buffer.size(), 0};
+						ret                = ZSTD_decompressStream(zs.get(), &out, &in);
+						if (ZSTD_isError(ret))
+							throw std::runtime_error("Failed to decompress entry.");
+						output(buffer.data(), out.pos);
+						if ((ret != 0) && (in.pos == in.size) && (out.pos < out.size))
+							break;
+					} while (ret != 0);
+
+					reader.consume(in.pos);
+					actual_compressed += in.pos;
+					_position = reader.position();
+				}
+#endif
+			} else {
+				// Deflate streams end on their own, so this also works when the size is only known afterwards.
+				z_stream zs = {};
+				if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+					throw std::runtime_error("Failed to initialize inflate.");
+				std::shared_ptr<z_stream> guard(&zs, [](z_stream* v) { inflateEnd(v); });
+
+				int ret = Z_OK;
+				while (ret != Z_STREAM_END) {
+					if (!reader.fill())
+						throw std::runtime_error("Unexpected end of archive.");
+					size_t input = std::min<size_t>(reader.size(), std::numeric_limits<uInt>::max());
+					zs.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(reader.data()));
+					zs.avail_in  = static_cast<uInt>(input);
+					do {
+						zs.next_out  = reinterpret_cast<Bytef*>(buffer.data());
+						zs.avail_out = static_cast<uInt>(buffer.size());
+						ret          = inflate(&zs, Z_NO_FLUSH);
+						if ((ret != Z_OK) && (ret != Z_STREAM_END) && (ret != Z_BUF_ERROR))
+							throw std::runtime_error("Failed to decompress entry.");
+						output(buffer.data(), buffer.size() - zs.avail_out);
+					} while ((zs.avail_out == 0) && (ret != Z_STREAM_END));
+
+					size_t consumed = input - zs.avail_in;
+					reader.consume(consumed);
+					actual_compressed += consumed;
+					_position = reader.position();
+				}
+			}
+
+			if (flags & ZIP_FLAG_DATA_DESCRIPTOR) {
+				// The signature of the data descriptor is optional.
+				if (uint32_t value; reader.peek_u32(value) && (value == ZIP_SIGNATURE_DATA_DESCRIPTOR)) {
+					reader.read_u32();
+				}
+				crc               = reader.read_u32();
+				compressed_size   = zip64 ? reader.read_u64() : reader.read_u32();
+				uncompressed_size = zip64 ? reader.read_u64() : reader.read_u32();
+			}
+			if ((actual_crc != crc) || (actual_compressed != compressed_size)
+				|| (actual_uncompressed != uncompressed_size)) {
+				throw std::runtime_error("Entry is damaged.");
+			}
+
+			if (stream) {
+				stream->commit();
+				if (actual_uncompressed > 0) {
+					_manifest.update(name, stagepath, actual_uncompressed, actual_crc);
+				}
+			}
+			_files++;
+			_position = reader.position();
+		}
+	} catch (std::exception const& ex) {
+		bool aborted;
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			aborted = _aborted;
+		}
+		if (!aborted) {
+			DLOG_INFO("Streaming extraction of '%s' stopped after %llu files: %s", _file_path.u8string().c_str(),
+					  _files.load(), ex.what());
+		}
+	}
+
+	// The manifest is saved by commit(), once the files it describes are in place.
+	std::unique_lock<std::mutex> lock(_lock);
+	_success = success;
+	_done    = true;
+	_cv.notify_all();
+}
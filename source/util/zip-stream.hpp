@@ -0,0 +1,92 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "zip.hpp"
+
+namespace own3d::util {
+	/** Extracts a ZIP archive from its local file headers while the file is still being downloaded.
+	 *
+	 * The file is read from the start up to the offset that is known to be complete, and every entry
+	 * is written to disk as soon as it has arrived. Only stored, deflated and, if built with zstd,
+	 * zstd compressed entries are supported. Anything else stops the extraction, and the caller is
+	 * expected to fall back to util::zip.
+	 *
+	 * Entries go to a staging directory next to the output, and only replace the files in the output
+	 * once commit() is called, so that nothing from a download that turns out damaged is left behind.
+	 */
+	class zip_stream {
+		std::filesystem::path   _file_path;
+		std::filesystem::path   _out_path;
+		std::filesystem::path   _stage_path;
+		zip_manifest            _manifest;
+		std::mutex              _lock;
+		std::condition_variable _cv;
+		uint64_t                _available;
+		bool                    _finished;
+		bool                    _aborted;
+		bool                    _done;
+		bool                    _success;
+		std::atomic<uint64_t>   _files;
+		std::atomic<uint64_t>   _position;
+		std::thread             _worker;
+
+		void run();
+
+		public:
+		~zip_stream();
+		zip_stream(std::filesystem::path path, std::filesystem::path output_path);
+
+		/** Make the file available from the start up to the offset.
+		 *
+		 * An offset smaller than a previous one means the file was started over, which stops the extraction.
+		 */
+		void advance(uint64_t offset);
+
+		/** Block until the file is available past the position.
+		 * @return The offset the file is available up to, or the position if no more data will arrive.
+		 */
+		uint64_t wait_available(uint64_t position);
+
+		/** No more data will arrive. */
+		void finish();
+
+		/** Stop the extraction as soon as possible. */
+		void abort();
+
+		/** Wait for the extraction to end.
+		 * @param callback Called with the files and bytes extracted so far, and the bytes available.
+		 * @return true if the archive was extracted completely.
+		 */
+		bool wait(std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> callback);
+
+		/** Number of entries extracted, including directories. */
+		uint64_t files();
+
+		/** Move the extracted files into the output, once wait() reported that the archive was extracted completely.
+		 *
+		 * Without a call to this, the extracted files are thrown away when the stream is destroyed.
+		 */
+		void commit();
+	};
+} // namespace own3d::util
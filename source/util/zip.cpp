@@ -15,23 +15,202 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "zip.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "blob-store.hpp"
+#include "json/json.hpp"
 #include "plugin.hpp"
 
+#include <zlib.h>
+
+// Name of the file in the output directory that lists what was extracted.
+constexpr std::string_view MANIFEST_NAME = ".own3d-manifest.json";
+
+static int64_t modification_time(std::filesystem::path const& file)
+{
+	std::error_code ec;
+	auto            time = std::filesystem::last_write_time(file, ec);
+	return ec ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+own3d::util::zip_manifest::~zip_manifest()
+{
+	try {
+		save();
+	} catch (...) {
+	}
+}
+
+own3d::util::zip_manifest::zip_manifest(std::filesystem::path output_path)
+	: _path(std::filesystem::path(output_path).append(MANIFEST_NAME)), _lock(), _entries(), _changed(false)
+{
+	try {
+		std::ifstream stream{_path, std::ios::binary | std::ios::in};
+		if (!stream.good())
+			return;
+
+		auto data = nlohmann::json::parse(stream);
+		for (auto& kv : data.at("files").items()) {
+			entry value;
+			value.size  = kv.value().at("size").get<uint64_t>();
+			value.crc   = kv.value().at("crc").get<uint32_t>();
+			value.mtime = kv.value().at("mtime").get<int64_t>();
+			_entries.emplace(kv.key(), value);
+		}
+	} catch (std::exception const& ex) {
+		// Without a manifest everything is extracted again, which is slower but still correct.
+		DLOG_WARNING("Ignoring damaged manifest '%s': %s", _path.u8string().c_str(), ex.what());
+		_entries.clear();
+	}
+}
+
+bool own3d::util::zip_manifest::unchanged(std::string const& name, std::filesystem::path const& file, uint64_t size,
+										  uint32_t crc)
+{
+	entry value;
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		auto                         itr = _entries.find(name);
+		if (itr == _entries.end())
+			return false;
+		value = itr->second;
+	}
+	if ((value.size != size) || (value.crc != crc))
+		return false;
+
+	// The size and time are enough to notice if the file was touched, without hashing it again.
+	std::error_code ec;
+	if ((std::filesystem::file_size(file, ec) != size) || ec)
+		return false;
+	return modification_time(file) == value.mtime;
+}
+
+void own3d::util::zip_manifest::update(std::string const& name, std::filesystem::path const& file, uint64_t size,
+									   uint32_t crc)
+{
+	entry value;
+	value.size  = size;
+	value.crc   = crc;
+	value.mtime = modification_time(file);
+
+	std::unique_lock<std::mutex> lock(_lock);
+	_entries[name] = value;
+	_changed       = true;
+}
+
+void own3d::util::zip_manifest::save()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	if (!_changed)
+		return;
+
+	auto files = nlohmann::json::object();
+	for (auto const& kv : _entries) {
+		files[kv.first] = {{"size", kv.second.size}, {"crc", kv.second.crc}, {"mtime", kv.second.mtime}};
+	}
+	auto data     = nlohmann::json::object();
+	data["files"] = files;
+
+	auto temporary = std::filesystem::path(_path).concat(".tmp");
+	{
+		std::ofstream stream{temporary, std::ios::binary | std::ios::trunc | std::ios::out};
+		stream << data.dump();
+		if (!stream.good())
+			throw std::runtime_error("Failed to write manifest.");
+	}
+	std::filesystem::rename(temporary, _path);
+	_changed = false;
+}
+
 own3d::util::zip::~zip()
 {
 	zip_close(_archive);
 }
 
+static zip_t* open_archive(std::filesystem::path const& path, own3d::util::mapped_file* mapping, int flags,
+						   int32_t& error)
+{
+	// Reading from the mapping saves libzip a system call for every block it reads.
+	if (mapping && mapping->data()) {
+		zip_error_t zerr;
+		zip_error_init(&zerr);
+		zip_source_t* source  = zip_source_buffer_create(mapping->data(), mapping->size(), 0, &zerr);
+		zip_t*        archive = source ? zip_open_from_source(source, flags, &zerr) : nullptr;
+		if (source && !archive) {
+			zip_source_free(source);
+		}
+		error = archive ? 0 : zip_error_code_zip(&zerr);
+		zip_error_fini(&zerr);
+		return archive;
+	}
+
+	return zip_open(path.u8string().c_str(), flags, &error);
+}
+
 own3d::util::zip::zip(std::filesystem::path path, std::filesystem::path output_path)
-	: _file_path(path), _out_path(output_path)
+	: _archive(nullptr), _file_path(path), _out_path(output_path),
+	  _manifest(std::make_shared<zip_manifest>(output_path)), _index(zip_index::load(path)), _mapping()
 {
+	try {
+		_mapping = std::make_shared<mapped_file>(_file_path);
+	} catch (std::exception const& ex) {
+		DLOG_WARNING("Failed to map archive '%s', reading it normally: %s", _file_path.u8string().c_str(), ex.what());
+	}
+
+	// An up to date index means that the archive was checked before, and hasn't changed since.
 	int32_t error = 0;
-	_archive      = zip_open(_file_path.u8string().c_str(), ZIP_CHECKCONS | ZIP_RDONLY, &error);
-	if (error != 0) {
+	_archive      = open_archive(_file_path, _mapping.get(), (_index ? 0 : ZIP_CHECKCONS) | ZIP_RDONLY, error);
+	if (!_archive) {
 		DLOG_ERROR("Unzipping file '%s' failed with error code %ld.", _file_path.u8string().c_str(), error);
 		throw std::runtime_error("Failed to read zip file.");
 	}
+
+	if (!_index) {
+		try {
+			_index = zip_index::create(_file_path);
+		} catch (std::exception const& ex) {
+			DLOG_WARNING("Failed to index archive '%s': %s", _file_path.u8string().c_str(), ex.what());
+		}
+	}
+	if (_index && (_index->count() != get_file_count())) {
+		// The index doesn't describe what libzip sees, so don't trust either of them to agree.
+		DLOG_WARNING("Index of archive '%s' does not match its contents.", _file_path.u8string().c_str());
+		_index.reset();
+	}
+
+	// Newer packs are compressed with zstd, which libzip only handles if it was built with it. Without an index, the
+	// central directory that libzip already read tells the same.
+	if (!zip_compression_method_supported(ZIP_CM_ZSTD, 0)) {
+		uint64_t count = get_file_count();
+		for (uint64_t idx = 0; idx < count; idx++) {
+			int32_t method = ZIP_CM_DEFAULT;
+			if (_index) {
+				method = _index->at(idx).method;
+			} else {
+				struct zip_stat stat;
+				zip_stat_init(&stat);
+				if ((zip_stat_index(_archive, idx, ZIP_FL_UNCHANGED, &stat) == 0)
+					&& ((stat.valid & ZIP_STAT_COMP_METHOD) != 0)) {
+					method = stat.comp_method;
+				}
+			}
+
+			if (method == ZIP_CM_ZSTD) {
+				DLOG_ERROR("Archive '%s' is compressed with zstd, which is not supported by this build.",
+						   _file_path.u8string().c_str());
+				zip_close(_archive);
+				throw std::runtime_error("Unsupported compression method in zip file.");
+			}
+		}
+	}
 }
 
 uint64_t own3d::util::zip::get_file_count()
@@ -39,43 +218,270 @@ uint64_t own3d::util::zip::get_file_count()
 	return zip_get_num_entries(_archive, ZIP_FL_UNCHANGED);
 }
 
-void own3d::util::zip::extract_file(uint64_t idx, std::function<void(uint64_t, uint64_t)> callback)
+std::string own3d::util::zip::get_file_name(uint64_t idx)
 {
-	std::shared_ptr<zip_file_t> file = std::shared_ptr<zip_file_t>(zip_fopen_index(_archive, idx, ZIP_FL_UNCHANGED),
-																   [](zip_file_t* v) { zip_fclose(v); });
-	if (!file) {
-		DLOG_ERROR("Failed to extract file index %lld from archive '%s'.", idx, _file_path.u8string().c_str());
-		throw std::runtime_error("Failed to extract file from archive.");
-	}
+	if (_index)
+		return std::string(_index->at(idx).name);
+
+	const char* name = zip_get_name(_archive, idx, ZIP_FL_ENC_GUESS);
+	if (!name)
+		throw std::runtime_error("Failed to read file name from archive.");
+	return name;
+}
+
+std::shared_ptr<own3d::util::zip_index> own3d::util::zip::get_index()
+{
+	return _index;
+}
+
+// Size of the blocks in which files are extracted, large enough to keep the number of writes low.
+constexpr size_t EXTRACT_BUFFER_SIZE = 1024 * 1024;
+// Upper limit for worker threads, past which the disk is the bottleneck anyway.
+constexpr size_t EXTRACT_MAX_THREADS = 16;
+// How often extract_all() reports progress.
+constexpr auto EXTRACT_PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+struct extract_context {
+	std::filesystem::path const& file_path;
+	std::filesystem::path const& out_path;
+	own3d::util::zip_manifest&   manifest;
+	own3d::util::mapped_file*    mapping; // Archive contents, if mapped.
+	own3d::util::zip_index*      index;
+};
+
+// Find the data of a stored entry in the mapping, so that it can be written out without going through libzip.
+static const uint8_t* find_stored(extract_context const& ctx, uint64_t idx, struct zip_stat const& stat)
+{
+	if (!ctx.mapping || !ctx.mapping->data() || !ctx.index || (idx >= ctx.index->count()))
+		return nullptr;
+	if (((stat.valid & ZIP_STAT_ENCRYPTION_METHOD) != 0) && (stat.encryption_method != ZIP_EM_NONE))
+		return nullptr;
+
+	auto const& entry = ctx.index->at(idx);
+	if ((entry.method != ZIP_CM_STORE) || (entry.compressed_size != entry.size) || (entry.size != stat.size)
+		|| (entry.name != stat.name))
+		return nullptr;
+	if ((entry.data_offset > ctx.mapping->size()) || (entry.size > (ctx.mapping->size() - entry.data_offset)))
+		return nullptr;
+	return ctx.mapping->data() + entry.data_offset;
+}
+
+static void extract_entry(zip_t* archive, extract_context const& ctx, uint64_t idx, std::vector<char>& buffer,
+						  std::function<void(uint64_t, uint64_t)> callback)
+{
+	auto const& file_path = ctx.file_path;
 
 	// Retrieve file info.
 	struct zip_stat stat;
-	zip_stat_index(_archive, idx, ZIP_FL_UNCHANGED, &stat);
+	zip_stat_init(&stat);
+	if (zip_stat_index(archive, idx, ZIP_FL_UNCHANGED, &stat) != 0) {
+		DLOG_ERROR("Failed to extract file index %lld from archive '%s'.", idx, file_path.u8string().c_str());
+		throw std::runtime_error("Failed to extract file from archive.");
+	}
 
 	// Update callback
 	callback(stat.size, 0);
 
 	// Build output file path.
-	std::filesystem::path filepath = _out_path;
+	std::filesystem::path filepath = ctx.out_path;
 	filepath.append(stat.name);
+
+	// Files that are still exactly what this entry would produce don't need to be written again.
+	bool has_crc = (stat.valid & ZIP_STAT_CRC) != 0;
+	if ((stat.size > 0) && has_crc && ctx.manifest.unchanged(stat.name, filepath, stat.size, stat.crc)) {
+		callback(stat.size, stat.size);
+		return;
+	}
+
+	const uint8_t*              stored = find_stored(ctx, idx, stat);
+	std::shared_ptr<zip_file_t> file;
+	if (!stored) {
+		file = std::shared_ptr<zip_file_t>(zip_fopen_index(archive, idx, ZIP_FL_UNCHANGED),
+										   [](zip_file_t* v) { zip_fclose(v); });
+		if (!file) {
+			DLOG_ERROR("Failed to extract file index %lld from archive '%s'.", idx, file_path.u8string().c_str());
+			throw std::runtime_error("Failed to extract file from archive.");
+		}
+	}
+
 	if (filepath.has_parent_path()) {
-		std::filesystem::create_directories(filepath.parent_path());
+		// Other threads may be creating the same directories right now.
+		std::error_code ec;
+		std::filesystem::create_directories(filepath.parent_path(), ec);
+		if (ec && !std::filesystem::is_directory(filepath.parent_path())) {
+			DLOG_ERROR("Failed to create directory for '%s' from archive '%s'.", stat.name,
+					   file_path.u8string().c_str());
+			throw std::runtime_error("Failed to extract file.");
+		}
 	}
 
 	// Write file
 	if (stat.size > 0) {
-		std::ofstream stream{filepath, std::ios::binary | std::ios::trunc | std::ios::out};
-		if (stream.bad()) {
-			DLOG_ERROR("Failed to extract file '%s' from archive '%s'.", stat.name, _file_path.u8string().c_str());
+		std::unique_ptr<own3d::util::blob_writer> stream;
+		try {
+			stream = std::make_unique<own3d::util::blob_writer>(filepath, stat.size);
+		} catch (...) {
+			DLOG_ERROR("Failed to extract file '%s' from archive '%s'.", stat.name, file_path.u8string().c_str());
 			throw std::runtime_error("Failed to extract file.");
 		}
-		std::vector<char> buffer;
-		buffer.resize(16384);
-		for (size_t n = 0; n < stat.size; n += buffer.size()) {
+		if (stored) {
+			// Straight from the mapping to the file, which leaves checking the CRC to us.
+			uLong crc = crc32(0, Z_NULL, 0);
+			for (uint64_t n = 0; n < stat.size;) {
+				callback(stat.size, n);
+				size_t length = static_cast<size_t>(std::min<uint64_t>(stat.size - n, EXTRACT_BUFFER_SIZE));
+				crc           = crc32(crc, stored + n, static_cast<uInt>(length));
+				stream->write(reinterpret_cast<const char*>(stored + n), length);
+				n += length;
+			}
+			if (static_cast<uint32_t>(crc) != ctx.index->at(idx).crc) {
+				DLOG_ERROR("File '%s' in archive '%s' is damaged.", stat.name, file_path.u8string().c_str());
+				throw std::runtime_error("Failed to extract file.");
+			}
+		}
+		for (uint64_t n = stored ? stat.size : 0; n < stat.size;) {
 			callback(stat.size, n);
-			uint64_t bytes = zip_fread(file.get(), buffer.data(), buffer.size());
-			stream.write(buffer.data(), bytes);
+			zip_int64_t bytes = zip_fread(file.get(), buffer.data(), buffer.size());
+			if (bytes <= 0) {
+				DLOG_ERROR("Failed to decompress file '%s' from archive '%s'.", stat.name,
+						   file_path.u8string().c_str());
+				throw std::runtime_error("Failed to extract file.");
+			}
+			stream->write(buffer.data(), static_cast<size_t>(bytes));
+			n += static_cast<uint64_t>(bytes);
+		}
+		stream->commit();
+		if (has_crc) {
+			ctx.manifest.update(stat.name, filepath, stat.size, stat.crc);
+		}
+	}
+}
+
+void own3d::util::zip::extract_file(uint64_t idx, std::function<void(uint64_t, uint64_t)> callback)
+{
+	// Kept around, so that extracting file by file doesn't allocate a new buffer every time.
+	thread_local std::vector<char> buffer(EXTRACT_BUFFER_SIZE);
+	extract_context                ctx{_file_path, _out_path, *_manifest, _mapping.get(), _index.get()};
+	extract_entry(_archive, ctx, idx, buffer, callback);
+}
+
+void own3d::util::zip::extract_all(size_t threads,
+								   std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> callback)
+{
+	std::vector<uint64_t> indices(get_file_count());
+	for (uint64_t idx = 0; idx < indices.size(); idx++) {
+		indices[idx] = idx;
+	}
+	extract(indices, threads, callback);
+}
+
+void own3d::util::zip::extract(std::vector<uint64_t> const& indices, size_t threads,
+							   std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> callback)
+{
+	struct entry {
+		uint64_t index;
+		uint64_t size;
+	};
+	std::vector<entry> entries;
+	uint64_t           total_bytes = 0;
+
+	// Largest files first, so that they don't end up as the long tail.
+	for (uint64_t idx : indices) {
+		if (_index) {
+			entries.push_back({idx, _index->at(idx).size});
+			total_bytes += entries.back().size;
+			continue;
+		}
+
+		struct zip_stat stat;
+		zip_stat_init(&stat);
+		if (zip_stat_index(_archive, idx, ZIP_FL_UNCHANGED, &stat) != 0)
+			continue;
+		entries.push_back({idx, ((stat.valid & ZIP_STAT_SIZE) != 0) ? stat.size : 0});
+		total_bytes += entries.back().size;
+	}
+	std::stable_sort(entries.begin(), entries.end(), [](entry const& a, entry const& b) { return a.size > b.size; });
+
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	threads = std::min<size_t>(std::max<size_t>(threads, 1), EXTRACT_MAX_THREADS);
+	threads = std::max<size_t>(std::min<size_t>(threads, entries.size()), 1);
+
+	std::atomic<size_t>     next{0};
+	std::atomic<uint64_t>   done_files{0};
+	std::atomic<uint64_t>   done_bytes{0};
+	std::atomic<bool>       abort{false};
+	std::mutex              lock;
+	std::condition_variable cv;
+	size_t                  running = threads;
+	std::exception_ptr      error;
+
+	auto worker = [&](size_t id) {
+		try {
+			// zip_t isn't thread-safe, so every worker reads the archive through its own handle.
+			zip_t* archive = _archive;
+			if (id > 0) {
+				int32_t code = 0;
+				archive      = open_archive(_file_path, _mapping.get(), ZIP_RDONLY, code);
+				if (!archive) {
+					DLOG_ERROR("Unzipping file '%s' failed with error code %ld.", _file_path.u8string().c_str(), code);
+					throw std::runtime_error("Failed to read zip file.");
+				}
+			}
+			std::shared_ptr<zip_t> handle(archive, [this](zip_t* v) {
+				if (v != _archive)
+					zip_close(v);
+			});
+
+			std::vector<char> buffer(EXTRACT_BUFFER_SIZE);
+			extract_context   ctx{_file_path, _out_path, *_manifest, _mapping.get(), _index.get()};
+			for (size_t idx = next++; (idx < entries.size()) && !abort; idx = next++) {
+				uint64_t reported = 0;
+				extract_entry(archive, ctx, entries[idx].index, buffer,
+							  [&done_bytes, &reported](uint64_t, uint64_t now) {
+								  done_bytes += now - reported;
+								  reported = now;
+							  });
+				done_bytes += entries[idx].size - reported;
+				done_files++;
+			}
+		} catch (...) {
+			std::unique_lock<std::mutex> ul(lock);
+			if (!error)
+				error = std::current_exception();
+			abort = true;
 		}
-		stream.close();
+
+		std::unique_lock<std::mutex> ul(lock);
+		running--;
+		cv.notify_all();
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t idx = 0; idx < threads; idx++) {
+		workers.emplace_back(worker, idx);
 	}
+
+	{ // Report progress until all workers are done.
+		std::unique_lock<std::mutex> ul(lock);
+		while (!cv.wait_for(ul, EXTRACT_PROGRESS_INTERVAL, [&running]() { return running == 0; })) {
+			ul.unlock();
+			callback(done_files, entries.size(), done_bytes, total_bytes);
+			ul.lock();
+		}
+	}
+	for (auto& thread : workers) {
+		thread.join();
+	}
+
+	// Also record what was extracted before an error, so that the next attempt can skip it.
+	try {
+		_manifest->save();
+	} catch (std::exception const& ex) {
+		DLOG_WARNING("Failed to save manifest for '%s': %s", _file_path.u8string().c_str(), ex.what());
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+	callback(done_files, entries.size(), done_bytes, total_bytes);
 }
@@ -18,15 +18,55 @@
 #include <cinttypes>
 #include <filesystem>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <zip.h>
+#include "mmap.hpp"
+#include "zip-index.hpp"
 
 namespace own3d {
 	namespace util {
+		/** Remembers which files were extracted into a directory, so that unchanged ones can be skipped.
+		 *
+		 * Every file is recorded with the size and CRC32 of the entry it was extracted from, and its
+		 * modification time afterwards, which tells whether it was changed on disk since.
+		 */
+		class zip_manifest {
+			struct entry {
+				uint64_t size  = 0;
+				uint32_t crc   = 0;
+				int64_t  mtime = 0;
+			};
+
+			std::filesystem::path        _path;
+			std::mutex                   _lock;
+			std::map<std::string, entry> _entries;
+			bool                         _changed;
+
+			public:
+			~zip_manifest();
+			zip_manifest(std::filesystem::path output_path);
+
+			/** Check if the file was extracted from an identical entry before, and left alone since. */
+			bool unchanged(std::string const& name, std::filesystem::path const& file, uint64_t size, uint32_t crc);
+
+			/** Record that the file was just extracted from an entry. */
+			void update(std::string const& name, std::filesystem::path const& file, uint64_t size, uint32_t crc);
+
+			void save();
+		};
+
 		class zip {
-			zip_t*                _archive;
-			std::filesystem::path _file_path;
-			std::filesystem::path _out_path;
+			zip_t*                        _archive;
+			std::filesystem::path         _file_path;
+			std::filesystem::path         _out_path;
+			std::shared_ptr<zip_manifest> _manifest;
+			std::shared_ptr<zip_index>    _index;
+			std::shared_ptr<mapped_file>  _mapping;
 
 			public:
 			~zip();
@@ -34,7 +74,26 @@ namespace own3d {
 
 			uint64_t get_file_count();
 
+			std::string get_file_name(uint64_t idx);
+
+			/** Index of the entries, or nullptr if the archive couldn't be indexed. */
+			std::shared_ptr<zip_index> get_index();
+
 			void extract_file(uint64_t idx, std::function<void(uint64_t, uint64_t)> callback);
+
+			/** Extract all files, spread across worker threads that each have their own handle to the archive.
+			 *
+			 * The largest files are started first, so that a single big file doesn't end up extracting
+			 * alone at the very end. Progress is reported from the calling thread.
+			 *
+			 * @param threads Number of worker threads, 0 to use one per core.
+			 * @param callback Called with the number of files and bytes extracted so far, and their totals.
+			 */
+			void extract_all(size_t threads, std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> callback);
+
+			/** Extract only some of the files, the same way as extract_all(). */
+			void extract(std::vector<uint64_t> const& indices, size_t threads,
+						 std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> callback);
 		};
 	} // namespace util
 } // namespace own3d
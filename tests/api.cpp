@@ -0,0 +1,109 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Runs the API requests of source/util/api.cpp against tools/stand-in-server.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "tests.hpp"
+#include "util/api.hpp"
+#include "util/retry.hpp"
+
+using namespace own3d;
+using namespace own3d::tests;
+
+/** A back off which tries again right away, so that the tests don't have to wait. */
+static std::shared_ptr<util::backoff> quick_retry()
+{
+	return std::make_shared<util::backoff>(std::chrono::milliseconds(10), std::chrono::milliseconds(100),
+										   std::chrono::milliseconds(0), 5);
+}
+
+static std::string request_token(std::shared_ptr<util::backoff> retry)
+{
+	std::promise<std::string> result;
+	auto                      future = result.get_future();
+	util::request_machine_token(endpoint() + "api/v1/machine-tokens/issue", "{}", retry,
+								[&result](std::string token) { result.set_value(token); });
+	return wait_for(future);
+}
+
+static std::vector<util::release> request_releases(std::shared_ptr<util::backoff> retry)
+{
+	std::promise<std::vector<util::release>> result;
+	auto                                     future = result.get_future();
+	util::request_releases(endpoint() + "api/v1/obs/releases", retry,
+						   [&result](std::vector<util::release> releases, std::string error) {
+							   if (error.length() > 0) {
+								   result.set_exception(std::make_exception_ptr(std::runtime_error(error)));
+							   } else {
+								   result.set_value(releases);
+							   }
+						   });
+	return wait_for(future);
+}
+
+static void test_token_retry()
+{
+	// The server fails the first two requests with 503.
+	auto retry = quick_retry();
+	auto token = request_token(retry);
+	expect(token.length() == 64, "Expected a token, got '" + token + "'.");
+	expect(retry->attempts() == 2, "Expected 2 retries, made " + std::to_string(retry->attempts()) + ".");
+}
+
+static void test_token_no_retry()
+{
+	// The server fails the first request with 400, which trying again won't fix.
+	auto retry = quick_retry();
+	auto token = request_token(retry);
+	expect(token.length() == 0, "Expected no token, got '" + token + "'.");
+	expect(retry->attempts() == 0, "Expected no retries, made " + std::to_string(retry->attempts()) + ".");
+}
+
+static void test_releases()
+{
+	// The server fails the first two requests with 503.
+	auto retry    = quick_retry();
+	auto releases = request_releases(retry);
+	expect(retry->attempts() == 2, "Expected 2 retries, made " + std::to_string(retry->attempts()) + ".");
+	expect(releases.size() == 2, "Expected 2 releases, got " + std::to_string(releases.size()) + ".");
+	expect((releases[0].tag_name == "1.0.0") && !releases[0].prerelease, "Expected the stable release first.");
+	expect((releases[1].tag_name == "99.0.0e1") && releases[1].prerelease, "Expected the testing release second.");
+}
+
+static void test_releases_failure()
+{
+	// The server keeps failing with 404, which is reported instead of being tried again.
+	auto retry = quick_retry();
+	try {
+		request_releases(retry);
+	} catch (std::exception const& ex) {
+		expect(std::string(ex.what()).find("404") != std::string::npos,
+			   "Expected the response code in the error, got '" + std::string(ex.what()) + "'.");
+		expect(retry->attempts() == 0, "Expected no retries, made " + std::to_string(retry->attempts()) + ".");
+		return;
+	}
+	throw std::runtime_error("Expected the request to fail.");
+}
+
+static registration api_tests({
+	{"token-retry", &test_token_retry},
+	{"token-no-retry", &test_token_no_retry},
+	{"releases", &test_releases},
+	{"releases-failure", &test_releases_failure},
+});
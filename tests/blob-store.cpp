@@ -0,0 +1,91 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Runs source/util/blob-store.cpp on the temporary directory, which needs no server.
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include "tests.hpp"
+#include "util/blob-store.hpp"
+
+using namespace own3d;
+using namespace own3d::tests;
+
+static void write_theme_file(std::filesystem::path path, std::string data)
+{
+	std::filesystem::create_directories(path.parent_path());
+	util::blob_writer writer(path, data.size());
+	writer.write(data.data(), data.size());
+	writer.commit();
+}
+
+static std::string read_file(std::filesystem::path path)
+{
+	std::ifstream stream{path, std::ios::binary | std::ios::in};
+	return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static void test_blob_store_edited()
+{
+	// Start with an empty store, which is where obs_module_config_path() points.
+	std::filesystem::remove_all(std::filesystem::temp_directory_path() / "own3d-tests" / "blobs");
+	util::blob_store::initialize();
+	auto store = util::blob_store::instance();
+	if (!store->supports_links()) {
+		printf("Hard links are not supported here, skipping.\n");
+		util::blob_store::finalize();
+		return;
+	}
+
+	// Two themes with the same file share it.
+	auto base = directory("blob-store");
+	write_theme_file(base / "a" / "image.png", "hello");
+	write_theme_file(base / "b" / "image.png", "hello");
+	expect(std::filesystem::hard_link_count(base / "a" / "image.png") == 3, "Expected the themes to share the file.");
+
+	// Editing one in place changes the other too, but the store must not hand the edited file out any further. The
+	// clock of the file system may be coarse, so give the edit a different modification time than the store's.
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	{
+		std::fstream stream{base / "a" / "image.png", std::ios::binary | std::ios::in | std::ios::out};
+		stream.write("j", 1);
+	}
+	expect(read_file(base / "b" / "image.png") == "jello", "Expected the themes to share the edited file.");
+
+	write_theme_file(base / "c" / "image.png", "hello");
+	expect(read_file(base / "c" / "image.png") == "hello", "Expected the new theme to get the original file.");
+	expect(std::filesystem::hard_link_count(base / "c" / "image.png") == 2,
+		   "Expected the new theme to share the file with the store only.");
+	expect(std::filesystem::hard_link_count(base / "a" / "image.png") == 2,
+		   "Expected the edited file to be left to the themes that have it.");
+
+	// A file that changed size is replaced just the same.
+	{
+		std::ofstream stream{base / "c" / "image.png", std::ios::binary | std::ios::app};
+		stream << "!";
+	}
+	write_theme_file(base / "d" / "image.png", "hello");
+	expect(read_file(base / "d" / "image.png") == "hello", "Expected the new theme to get the original file.");
+	expect(std::filesystem::hard_link_count(base / "d" / "image.png") == 2,
+		   "Expected the new theme to share the file with the store only.");
+
+	util::blob_store::finalize();
+}
+
+static registration blob_store_tests({
+	{"blob-store-edited", &test_blob_store_edited},
+});
@@ -0,0 +1,144 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Runs the downloads of source/util/download.cpp against tools/stand-in-server.
+
+#include <fstream>
+#include <string>
+#include "tests.hpp"
+#include "util/download.hpp"
+#include "util/http-statistics.hpp"
+#include "util/retry.hpp"
+
+using namespace own3d;
+using namespace own3d::tests;
+
+static std::string read_file(std::filesystem::path path)
+{
+	std::ifstream stream{path, std::ios::binary | std::ios::in};
+	return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+/** Download the pack, and check that the part which is complete never shrinks. */
+static std::string download_pack(std::string url, std::filesystem::path path)
+{
+	util::download download(url, path, "", "test pack");
+	uint64_t       last = 0;
+	bool           ok   = true;
+	download.set_advance_callback([&last, &ok](uint64_t offset) {
+		ok   = ok && (offset >= last);
+		last = offset;
+	});
+	download.fetch();
+
+	expect(ok, "Expected the download to continue where it left off, instead of starting over.");
+	expect(last == std::filesystem::file_size(path), "Expected the whole file to be complete.");
+	expect(!std::filesystem::exists(std::filesystem::path(path).concat(".resume")),
+		   "Expected the resume information to be removed.");
+
+	return read_file(path);
+}
+
+static void test_download_resume()
+{
+	// The server fails the probe for ranges, and then cuts the download off halfway through.
+	auto url  = endpoint() + "packs/resume.pack";
+	auto data = download_pack(url, directory("download-resume") / "resume.pack");
+
+	auto full = fetch(url);
+	expect(digest(data) == digest(full.body), "Resumed download differs from the full one.");
+}
+
+static void test_download_segmented()
+{
+	// The pack is large enough to be split, and the server cuts off some of the segments.
+	auto url  = endpoint() + "packs/segmented.pack";
+	auto data = download_pack(url, directory("download-segmented") / "segmented.pack");
+
+	auto full = fetch(url);
+	expect(digest(data) == digest(full.body), "Segmented download differs from the full one.");
+
+	// The probe, one request per segment, and the ones which were cut off.
+	auto stats    = util::http_statistics::instance()->query();
+	auto requests = stats[util::circuit_breaker::endpoint(url)].requests;
+	expect(requests >= 7, "Expected the pack to be downloaded in segments, made " + std::to_string(requests)
+							  + " requests.");
+}
+
+static void test_download_verify()
+{
+	auto url  = endpoint() + "packs/verify.pack";
+	auto path = directory("download-verify") / "verify.pack";
+	auto hash = digest(fetch(url).body);
+
+	{ // A damaged download is caught, and never reused.
+		util::download download(url, path, std::string(64, '0'), "test pack");
+		download.fetch();
+		expect(!download.verify(), "Expected the download not to match a different hash.");
+		expect(!download.reuse(), "Expected a download that didn't match not to be reused.");
+	}
+
+	{ // A good download is remembered, so that it doesn't have to be downloaded again.
+		util::download download(url, path, hash, "test pack");
+		download.fetch();
+		expect(download.verify(), "Expected the download to match its hash.");
+		expect(download.reuse(), "Expected a verified download to be reused.");
+	}
+
+	{ // Until the file changes.
+		std::ofstream stream{path, std::ios::binary | std::ios::app};
+		stream << "changed";
+	}
+	{
+		util::download download(url, path, hash, "test pack");
+		expect(!download.reuse(), "Expected a changed download not to be reused.");
+	}
+
+	{ // Without a hash, nothing can be told about the file.
+		util::download download(url, path, "", "test pack");
+		download.fetch();
+		expect(download.verify(), "Expected a download without hash to be accepted.");
+		expect(!download.reuse(), "Expected a download without hash not to be reused.");
+	}
+}
+
+static void test_download_reinstall(std::string name)
+{
+	// Installing a theme lazily links its pack to the download, which a later download must leave alone.
+	auto base  = directory(name);
+	auto path  = base / "reinstall.pack";
+	auto theme = base / "theme" / ".own3d-theme.pack";
+	download_pack(endpoint() + "packs/reinstall.pack?v=1", path);
+	std::filesystem::create_directories(theme.parent_path());
+	std::filesystem::create_hard_link(path, theme);
+	auto installed = read_file(theme);
+
+	// The theme was updated since, and is downloaded to the same file again.
+	auto url  = endpoint() + "packs/reinstall.pack?v=2";
+	auto data = download_pack(url, path);
+	expect(digest(data) == digest(fetch(url).body), "Expected the updated pack to be downloaded.");
+	expect(digest(data) != digest(installed), "Expected the updated pack to differ from the installed one.");
+	expect(digest(read_file(theme)) == digest(installed), "Expected the installed theme to keep its pack.");
+	expect(std::filesystem::hard_link_count(theme) == 1, "Expected the installed pack to be on its own.");
+}
+
+static registration download_tests({
+	{"download-resume", &test_download_resume},
+	{"download-segmented", &test_download_segmented},
+	{"download-verify", &test_download_verify},
+	{"download-reinstall", []() { test_download_reinstall("download-reinstall"); }},
+	{"download-reinstall-segmented", []() { test_download_reinstall("download-reinstall-segmented"); }},
+});
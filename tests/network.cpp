@@ -0,0 +1,217 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Runs the transfer code against tools/stand-in-server.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "tests.hpp"
+#include "util/curl.hpp"
+#include "util/http-cache.hpp"
+#include "util/http-engine.hpp"
+#include "util/retry.hpp"
+
+using namespace own3d;
+using namespace own3d::tests;
+
+// Name of the generated pack that the transfer tests fetch.
+constexpr std::string_view TEST_PACK = "packs/test.pack";
+
+static void test_conditional_get()
+{
+	// The server allows caching, but wants every use revalidated.
+	std::error_code ec;
+	std::filesystem::remove_all(std::filesystem::temp_directory_path() / "own3d-tests" / "cache", ec);
+	util::http_cache::initialize();
+
+	auto url   = endpoint() + "api/v1/obs/releases";
+	auto first = fetch(url, "", "", true);
+	expect(first.result == CURLE_OK, std::string("First request failed: ") + curl_easy_strerror(first.result));
+	expect((first.statuses.size() == 1) && (first.statuses[0] == 200), "Expected the first request to return 200.");
+	expect(!first.cached, "First request was answered from the cache.");
+	expect(first.body.length() > 0, "First request returned no body.");
+
+	auto second = fetch(url, "", "", true);
+	expect(second.result == CURLE_OK, std::string("Second request failed: ") + curl_easy_strerror(second.result));
+	expect((second.statuses.size() == 1) && (second.statuses[0] == 304),
+		   "Expected the second request to be conditional and return 304.");
+	expect(second.code == 200, "Expected the stored response code, got " + std::to_string(second.code) + ".");
+	expect(second.cached, "Second request was not answered from the cache.");
+	expect(second.body == first.body, "Second request returned a different body.");
+
+	util::http_cache::finalize();
+}
+
+static void test_stale_on_error()
+{
+	// The server answers the first request, and fails every later one with a 503 error page.
+	std::error_code ec;
+	std::filesystem::remove_all(std::filesystem::temp_directory_path() / "own3d-tests" / "cache", ec);
+	util::http_cache::initialize();
+
+	auto url   = endpoint() + "api/v1/obs/releases";
+	auto first = fetch(url, "", "", true);
+	expect(first.result == CURLE_OK, std::string("First request failed: ") + curl_easy_strerror(first.result));
+	expect(first.code == 200, "Expected the first request to succeed, got " + std::to_string(first.code) + ".");
+
+	auto second = fetch(url, "", "", true);
+	expect(second.result == CURLE_OK, std::string("Second request failed: ") + curl_easy_strerror(second.result));
+	expect((second.statuses.size() == 1) && (second.statuses[0] == 503), "Expected the server to fail the request.");
+	expect(second.code == 200, "Expected the stored response code, got " + std::to_string(second.code) + ".");
+	expect(second.cached, "Second request was not answered from the cache.");
+	expect(second.body == first.body, "Expected the stored body, got '" + second.body + "'.");
+
+	// Without a stored response, the caller still gets to see the error.
+	auto other = fetch(endpoint() + "api/v1/obs/other", "", "", true);
+	expect(other.code == 503, "Expected the error, got " + std::to_string(other.code) + ".");
+	expect(other.body.length() > 0, "Expected the error page to be delivered.");
+
+	util::http_cache::finalize();
+}
+
+static void test_resume()
+{
+	// The server cuts the first request off halfway through.
+	auto url     = endpoint() + std::string(TEST_PACK);
+	auto partial = fetch(url);
+	expect(partial.result != CURLE_OK, "Expected the first request to be cut off.");
+	expect(util::is_retryable(partial.result, partial.code),
+		   std::string("Expected a retryable error, got: ") + curl_easy_strerror(partial.result));
+	expect(partial.body.length() > 0, "First request returned no data.");
+
+	auto validator = util::curl::if_range_validator(partial.etag, partial.last_modified);
+	expect(validator == partial.etag, "Expected the strong entity tag to be used as validator.");
+	auto rest = fetch(url, std::to_string(partial.body.length()) + "-", validator);
+	expect(rest.result == CURLE_OK, std::string("Resuming failed: ") + curl_easy_strerror(rest.result));
+	expect(rest.code == 206, "Expected a partial response, got " + std::to_string(rest.code) + ".");
+
+	auto full = fetch(url);
+	expect(full.result == CURLE_OK, std::string("Full request failed: ") + curl_easy_strerror(full.result));
+	expect(digest(partial.body + rest.body) == digest(full.body), "Resumed download differs from the full one.");
+
+	// A validator that doesn't match anymore must restart the transfer with the whole file.
+	auto changed = fetch(url, std::to_string(partial.body.length()) + "-", "\"changed\"");
+	expect(changed.result == CURLE_OK, std::string("Changed request failed: ") + curl_easy_strerror(changed.result));
+	expect(changed.code == 200, "Expected the whole file, got " + std::to_string(changed.code) + ".");
+	expect(digest(changed.body) == digest(full.body), "Restarted download differs from the full one.");
+}
+
+static void test_resume_weak_etag()
+{
+	// The server only has weak entity tags, so resuming has to rely on Last-Modified.
+	auto url  = endpoint() + std::string(TEST_PACK);
+	auto head = fetch(url, "0-1023");
+	expect(head.result == CURLE_OK, std::string("First request failed: ") + curl_easy_strerror(head.result));
+	expect(head.etag.substr(0, 2) == "W/", "Expected a weak entity tag, got '" + head.etag + "'.");
+
+	auto validator = util::curl::if_range_validator(head.etag, head.last_modified);
+	expect(validator == head.last_modified, "Expected Last-Modified as validator, got '" + validator + "'.");
+	auto rest = fetch(url, std::to_string(head.body.length()) + "-", validator);
+	expect(rest.result == CURLE_OK, std::string("Resuming failed: ") + curl_easy_strerror(rest.result));
+	expect(rest.code == 206, "Expected a partial response, got " + std::to_string(rest.code) + ".");
+
+	auto full = fetch(url);
+	expect(digest(head.body + rest.body) == digest(full.body), "Resumed download differs from the full one.");
+}
+
+static void test_segmented()
+{
+	auto url  = endpoint() + std::string(TEST_PACK);
+	auto full = fetch(url);
+	expect(full.result == CURLE_OK, std::string("Full request failed: ") + curl_easy_strerror(full.result));
+	auto validator = util::curl::if_range_validator(full.etag, full.last_modified);
+
+	// Fetch the file in as many parts as there may be connections to the host, all at once.
+	struct segment {
+		std::shared_ptr<util::curl> curl;
+		std::string                 data;
+		long                        code = 0;
+		std::future<CURLcode>       result;
+	};
+	auto   engine   = util::http_engine::instance();
+	size_t count    = engine->get_max_host_transfers();
+	size_t size     = full.body.length() / count;
+	auto   segments = std::vector<segment>(count);
+	for (size_t idx = 0; idx < count; idx++) {
+		auto&  seg   = segments[idx];
+		size_t start = idx * size;
+		size_t end   = (idx + 1 == count) ? (full.body.length() - 1) : (start + size - 1);
+		seg.curl     = std::make_shared<util::curl>();
+		seg.curl->set_option(CURLOPT_URL, url);
+		seg.curl->set_option(CURLOPT_TIMEOUT, 30L);
+		seg.curl->set_option(CURLOPT_RANGE, std::to_string(start) + "-" + std::to_string(end));
+		seg.curl->set_compression(false);
+		seg.curl->set_header("If-Range", validator);
+		seg.curl->set_write_callback([&seg](void* buf, size_t n, size_t c) {
+			seg.data.append(reinterpret_cast<char*>(buf), n * c);
+			return n * c;
+		});
+		seg.result = engine->submit(seg.curl);
+	}
+
+	std::string joined;
+	for (auto& seg : segments) {
+		auto res = wait_for(seg.result);
+		seg.curl->get_info(CURLINFO_RESPONSE_CODE, seg.code);
+		expect(res == CURLE_OK, std::string("Segment failed: ") + curl_easy_strerror(res));
+		expect(seg.code == 206, "Expected a partial response, got " + std::to_string(seg.code) + ".");
+		joined.append(seg.data);
+	}
+	expect(digest(joined) == digest(full.body), "Segmented download differs from the full one.");
+}
+
+static void test_failure_injection()
+{
+	// The server fails every request with 503, so the circuit breaker must eventually stop sending them.
+	auto   base     = endpoint();
+	auto   url      = base + "api/v1/obs/releases";
+	size_t attempts = 0;
+	bool   open     = false;
+	for (; (attempts < 20) && !open; attempts++) {
+		auto value = fetch(url);
+		if ((value.result != CURLE_OK) && value.statuses.empty()) {
+			expect(value.result == CURLE_COULDNT_CONNECT,
+				   std::string("Expected the request to fail fast, got: ") + curl_easy_strerror(value.result));
+			open = true;
+		} else {
+			expect(value.code == 503, "Expected the injected failure, got " + std::to_string(value.code) + ".");
+			expect(util::is_retryable(value.result, value.code), "Expected the injected failure to be retryable.");
+		}
+	}
+	expect(open, "Circuit breaker didn't open after " + std::to_string(attempts) + " failures.");
+
+	// Other API routes and files on the same host are tracked separately, and must still be tried.
+	for (auto other : {base + "api/v1/machine-tokens/issue", base + std::string(TEST_PACK)}) {
+		auto value = fetch(other);
+		expect(value.code == 503, "Expected " + other + " to reach the server, got " + std::to_string(value.code));
+	}
+
+	// Files are grouped, so that they don't each get an entry, but API routes are not.
+	expect(util::circuit_breaker::endpoint(base + "api/v1/obs/releases?x=1") == base + "api/v1/obs/releases",
+		   "Expected the API route to be kept without its query.");
+	expect(util::circuit_breaker::endpoint(base + "packs/a.pack") == base + "packs",
+		   "Expected files to be grouped by their directory.");
+}
+
+static registration network_tests({
+	{"conditional-get", &test_conditional_get},
+	{"stale-on-error", &test_stale_on_error},
+	{"resume", &test_resume},
+	{"resume-weak-etag", &test_resume_weak_etag},
+	{"segmented", &test_segmented},
+	{"failure-injection", &test_failure_injection},
+});
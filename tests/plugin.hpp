@@ -0,0 +1,88 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Stands in for source/plugin.hpp, so that the networking code in source/util can be tested without libOBS. The test
+// target puts this directory in front of source/, which makes '#include "plugin.hpp"' pick up this file instead.
+
+#pragma once
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#define OWN3D_USER_AGENT "OWN3D Pro OBS Plugin/Tests"
+
+/// Log Functionality
+#define DLOG_PREFIX "[OWN3D Pro]"
+#define DLOG_(level, ...) own3d::tests::log(level, DLOG_PREFIX " " __VA_ARGS__)
+#define DLOG_ERROR(...) DLOG_("error", __VA_ARGS__)
+#define DLOG_WARNING(...) DLOG_("warning", __VA_ARGS__)
+#define DLOG_INFO(...) DLOG_("info", __VA_ARGS__)
+#define DLOG_DEBUG(...) DLOG_("debug", __VA_ARGS__)
+
+typedef struct obs_data obs_data_t;
+
+inline void obs_data_set_default_int(obs_data_t*, const char*, long long) {}
+
+inline long long obs_data_get_int(obs_data_t*, const char*)
+{
+	return 0;
+}
+
+inline char* obs_module_config_path(const char* file)
+{
+	auto path = (std::filesystem::temp_directory_path() / "own3d-tests" / file).u8string();
+	return strdup(path.c_str());
+}
+
+inline void bfree(void* ptr)
+{
+	free(ptr);
+}
+
+namespace own3d {
+	namespace tests {
+		inline void log(const char* level, const char* format, ...)
+		{
+			va_list args;
+			va_start(args, format);
+			fprintf(stderr, "%s: ", level);
+			vfprintf(stderr, format, args);
+			fprintf(stderr, "\n");
+			va_end(args);
+		}
+	} // namespace tests
+
+	/** The tests run with the default configuration. */
+	class configuration {
+		public:
+		std::shared_ptr<obs_data_t> get()
+		{
+			return nullptr;
+		}
+
+		void save() {}
+
+		static std::shared_ptr<own3d::configuration> instance()
+		{
+			return nullptr;
+		}
+	};
+} // namespace own3d
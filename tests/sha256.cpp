@@ -0,0 +1,120 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Checks source/util/sha256.cpp against the known answers from FIPS 180-2, which needs no server.
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "tests.hpp"
+#include "util/sha256.hpp"
+
+using namespace own3d;
+using namespace own3d::tests;
+
+/** Hash the data in pieces of the given size, so that updates end anywhere within a block. */
+static std::string hash_in_pieces(std::string_view data, size_t piece)
+{
+	util::sha256 hash;
+	for (size_t offset = 0; offset < data.size(); offset += piece) {
+		auto part = data.substr(offset, piece);
+		hash.update(part.data(), part.size());
+	}
+	return util::sha256::to_string(hash.finalize());
+}
+
+static void test_sha256_known_answers()
+{
+	static const std::vector<std::pair<std::string, std::string>> answers = {
+		{"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+		{"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+		{"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		 "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+		{"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrst"
+		 "nopqrstu",
+		 "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+		{std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+	};
+
+	for (auto const& kv : answers) {
+		auto name = kv.first.substr(0, 16) + " (" + std::to_string(kv.first.size()) + " bytes)";
+		expect(digest(kv.first) == kv.second, "Wrong hash for '" + name + "'.");
+
+		// Pieces that fit, or don't fit, the 64 byte blocks and the 56 bytes before the length.
+		for (size_t piece : {1, 3, 55, 56, 57, 63, 64, 65, 127, 4096}) {
+			expect(hash_in_pieces(kv.first, piece) == kv.second,
+				   "Wrong hash for '" + name + "' in pieces of " + std::to_string(piece) + " bytes.");
+		}
+	}
+}
+
+static void test_sha256_padding()
+{
+	// Messages around the block size need the padding to spill into another block, or not.
+	util::sha256 hash;
+	for (size_t length = 0; length <= 130; length++) {
+		std::string data;
+		for (size_t idx = 0; idx < length; idx++) {
+			data.push_back(static_cast<char>('a' + (idx % 26)));
+		}
+		auto expected = digest(data);
+		expect(hash_in_pieces(data, 1) == expected,
+			   "Byte-wise hash differs for " + std::to_string(length) + " bytes.");
+
+		// The same object is used for every length, which must not carry anything over.
+		hash.reset();
+		hash.update(data.data(), data.size());
+		expect(util::sha256::to_string(hash.finalize()) == expected,
+			   "Reused hash differs for " + std::to_string(length) + " bytes.");
+	}
+}
+
+static void test_sha256_file()
+{
+	auto path = directory("sha256") / "message.txt";
+	{
+		std::ofstream stream{path, std::ios::binary | std::ios::out};
+		stream << "xxabcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	}
+
+	util::sha256 hash;
+	expect(hash.update_file(path, 2), "Failed to read the file.");
+	expect(util::sha256::to_string(hash.finalize())
+			   == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		   "Wrong hash for the file after its offset.");
+
+	hash.reset();
+	expect(hash.update_file(path, 2, 3), "Failed to read the range of the file.");
+	expect(util::sha256::to_string(hash.finalize())
+			   == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		   "Wrong hash for the range of the file.");
+
+	hash.reset();
+	expect(!hash.update_file(path, 2, 1000), "Expected reading past the end of the file to fail.");
+
+	util::sha256::digest_t parsed;
+	expect(util::sha256::from_string("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD", parsed),
+		   "Expected the digest to be parsed.");
+	expect(util::sha256::to_string(parsed) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		   "Expected the parsed digest to be printed in lower case.");
+	expect(!util::sha256::from_string("ba7816bf", parsed), "Expected a short digest to be rejected.");
+}
+
+static registration sha256_tests({
+	{"sha256-known-answers", &test_sha256_known_answers},
+	{"sha256-padding", &test_sha256_padding},
+	{"sha256-file", &test_sha256_file},
+});
@@ -0,0 +1,146 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Usage: own3d-tests <test>. Network tests are started by ctest through tools/stand-in-server, which points
+// OWN3D_ENDPOINT at itself and injects the failures each test needs.
+
+#include "tests.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include "util/curl.hpp"
+#include "util/http-engine.hpp"
+#include "util/http-statistics.hpp"
+#include "util/retry.hpp"
+#include "util/sha256.hpp"
+#include "util/throttle.hpp"
+
+using namespace own3d;
+
+std::map<std::string, tests::test_t>& tests::registry()
+{
+	static std::map<std::string, test_t> tests;
+	return tests;
+}
+
+tests::registration::registration(std::initializer_list<std::pair<const std::string, test_t>> tests)
+{
+	registry().insert(tests);
+}
+
+std::string tests::endpoint()
+{
+	if (const char* value = getenv("OWN3D_ENDPOINT"); value && (value[0] != '\0')) {
+		return value;
+	}
+	throw std::runtime_error("OWN3D_ENDPOINT must point at tools/stand-in-server.");
+}
+
+std::filesystem::path tests::directory(std::string name)
+{
+	auto path = std::filesystem::temp_directory_path() / "own3d-tests" / name;
+	std::filesystem::remove_all(path);
+	std::filesystem::create_directories(path);
+	return path;
+}
+
+void tests::expect(bool condition, std::string message)
+{
+	if (!condition) {
+		throw std::runtime_error(message);
+	}
+}
+
+tests::response tests::fetch(std::string url, std::string range, std::string validator, bool cache)
+{
+	response   value;
+	util::curl curl;
+	curl.set_option(CURLOPT_URL, url);
+	curl.set_option(CURLOPT_TIMEOUT, 30L);
+	curl.set_compression(false);
+	curl.set_cache(cache);
+	if (range.length() > 0) {
+		curl.set_option(CURLOPT_RANGE, range);
+	}
+	if (validator.length() > 0) {
+		curl.set_header("If-Range", validator);
+	}
+	curl.set_header_callback([&value](void* buf, size_t n, size_t c) {
+		std::string_view line{reinterpret_cast<char*>(buf), n * c};
+		std::string      key, text;
+		if (long code = util::curl::parse_status(line); code != 0) {
+			value.statuses.push_back(code);
+		} else if (util::curl::parse_header(line, key, text)) {
+			if (key == "etag") {
+				value.etag = text;
+			} else if (key == "last-modified") {
+				value.last_modified = text;
+			}
+		}
+		return n * c;
+	});
+	curl.set_write_callback([&value](void* buf, size_t n, size_t c) {
+		value.body.append(reinterpret_cast<char*>(buf), n * c);
+		return n * c;
+	});
+
+	value.result = curl.perform();
+	curl.get_info(CURLINFO_RESPONSE_CODE, value.code);
+	value.cached = curl.is_cached_response();
+	return value;
+}
+
+std::string tests::digest(std::string_view data)
+{
+	util::sha256 hash;
+	hash.update(data.data(), data.size());
+	return util::sha256::to_string(hash.finalize());
+}
+
+int main(int argc, const char* argv[])
+{
+	auto& all = tests::registry();
+	if ((argc < 2) || (all.count(argv[1]) == 0)) {
+		fprintf(stderr, "Usage: %s <test>\nTests:\n", argv[0]);
+		for (auto& kv : all) {
+			fprintf(stderr, "\t%s\n", kv.first.c_str());
+		}
+		return 1;
+	}
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	util::curl_share::initialize();
+	util::circuit_breaker::initialize();
+	util::throttle::initialize();
+	util::http_statistics::initialize();
+	util::http_engine::initialize();
+
+	int result = 0;
+	try {
+		all.at(argv[1])();
+		printf("%s: passed\n", argv[1]);
+	} catch (std::exception const& ex) {
+		fprintf(stderr, "%s: failed: %s\n", argv[1], ex.what());
+		result = 1;
+	}
+
+	util::http_engine::finalize();
+	util::http_statistics::finalize();
+	util::throttle::finalize();
+	util::circuit_breaker::finalize();
+	util::curl_share::finalize();
+	curl_global_cleanup();
+	return result;
+}
@@ -0,0 +1,79 @@
+// Integration of the OWN3D service into OBS Studio
+// Copyright (C) 2021 own3d media GmbH <support@own3d.tv>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <curl/curl.h>
+}
+
+namespace own3d::tests {
+	// How long to wait for any single test step before considering it hung.
+	constexpr auto TIMEOUT = std::chrono::seconds(60);
+
+	typedef std::function<void()> test_t;
+
+	/** All tests, by the name they are run with. */
+	std::map<std::string, test_t>& registry();
+
+	/** Adds tests to the registry, from a static instance in the file that defines them. */
+	struct registration {
+		registration(std::initializer_list<std::pair<const std::string, test_t>> tests);
+	};
+
+	/** URL of tools/stand-in-server, from OWN3D_ENDPOINT. */
+	std::string endpoint();
+
+	/** Empty directory in the temporary directory, for files created by a test. */
+	std::filesystem::path directory(std::string name);
+
+	void expect(bool condition, std::string message);
+
+	template<typename T>
+	T wait_for(std::future<T>& future)
+	{
+		if (future.wait_for(TIMEOUT) != std::future_status::ready) {
+			throw std::runtime_error("Timed out.");
+		}
+		return future.get();
+	}
+
+	struct response {
+		CURLcode          result = CURLE_OK;
+		long              code   = 0;
+		std::vector<long> statuses;
+		std::string       etag;
+		std::string       last_modified;
+		std::string       body;
+		bool              cached = false;
+	};
+
+	/** Make a GET request through util::curl::perform(), optionally for a range and only if the validator matches. */
+	response fetch(std::string url, std::string range = "", std::string validator = "", bool cache = false);
+
+	std::string digest(std::string_view data);
+} // namespace own3d::tests
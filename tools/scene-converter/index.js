@@ -1,10 +1,31 @@
 let process = require('process');
 let fs = require('fs');
 let path = require('path');
+let zlib = require('zlib');
+let child_process = require('child_process');
 
 // Initialization
 let args = process.argv.slice(2);
 
+// Options
+let pack_file = null;
+let pack_zstd = false;
+for (let idx = 0; idx < args.length;) {
+	if (args[idx] == "--pack") {
+		pack_file = args[idx + 1];
+		args.splice(idx, 2);
+	} else if (args[idx] == "--zstd") {
+		pack_zstd = true;
+		args.splice(idx, 1);
+	} else {
+		idx++;
+	}
+}
+if ((pack_file === undefined) || (pack_zstd && !pack_file)) {
+	console.error("Missing pack file argument.");
+	process.exit(1);
+}
+
 // Input File
 if (args.length != 1) {
 	console.error("Missing file argument.");
@@ -89,3 +110,136 @@ for (let value of json.transitions) {
 }
 
 fs.writeFileSync(path.join(path_output, 'data.json'), JSON.stringify(json));
+
+// Pack the output into a theme pack, which is a ZIP archive.
+const ZIP_METHOD_STORE = 0;
+const ZIP_METHOD_DEFLATE = 8;
+const ZIP_METHOD_ZSTD = 93;
+
+let crc_table = [];
+for (let n = 0; n < 256; n++) {
+	let c = n;
+	for (let k = 0; k < 8; k++) {
+		c = (c & 1) ? (0xEDB88320 ^ (c >>> 1)) : (c >>> 1);
+	}
+	crc_table[n] = c >>> 0;
+}
+function crc32(data) {
+	let crc = 0xFFFFFFFF;
+	for (let idx = 0; idx < data.length; idx++) {
+		crc = crc_table[(crc ^ data[idx]) & 0xFF] ^ (crc >>> 8);
+	}
+	return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+function compress(data, zstd) {
+	let compressed;
+	if (!zstd) {
+		compressed = zlib.deflateRawSync(data, { level: 9 });
+	} else if (typeof (zlib.zstdCompressSync) == "function") {
+		compressed = zlib.zstdCompressSync(data, {
+			params: { [zlib.constants.ZSTD_c_compressionLevel]: 19, [zlib.constants.ZSTD_c_contentSizeFlag]: 1 }
+		});
+	} else {
+		// Older versions of NodeJS don't have zstd, so use the command line tool instead.
+		let result = child_process.spawnSync("zstd", ["-q", "-19", "-c", "-"], { input: data, maxBuffer: Infinity });
+		if ((result.error) || (result.status != 0)) {
+			console.error("Compressing with zstd requires NodeJS 22.15 or the zstd command line tool.");
+			process.exit(1);
+		}
+		compressed = result.stdout;
+	}
+
+	// Already compressed files like images and videos are better off stored, the plugin can copy them directly.
+	if (compressed.length >= data.length) {
+		return { method: ZIP_METHOD_STORE, data: data };
+	}
+	return { method: (zstd ? ZIP_METHOD_ZSTD : ZIP_METHOD_DEFLATE), data: compressed };
+}
+
+function dos_time(date) {
+	let time = (date.getHours() << 11) | (date.getMinutes() << 5) | (date.getSeconds() >> 1);
+	let day = ((Math.max(date.getFullYear(), 1980) - 1980) << 9) | ((date.getMonth() + 1) << 5) | date.getDate();
+	return { time: time, date: day };
+}
+
+function list_files(directory, prefix, files) {
+	for (let name of fs.readdirSync(directory).sort()) {
+		let file = path.join(directory, name);
+		if (fs.statSync(file).isDirectory()) {
+			list_files(file, prefix + name + "/", files);
+		} else {
+			files.push({ file: file, name: prefix + name });
+		}
+	}
+	return files;
+}
+
+function write_pack(file, directory, zstd) {
+	let output = fs.openSync(file, "w");
+	let offset = 0;
+	let central = [];
+	let write = function (buffer) {
+		fs.writeSync(output, buffer);
+		offset += buffer.length;
+	};
+
+	for (let entry of list_files(directory, "", [])) {
+		let data = fs.readFileSync(entry.file);
+		let packed = compress(data, zstd);
+		let name = Buffer.from(entry.name, "utf8");
+		let time = dos_time(fs.statSync(entry.file).mtime);
+		let crc = crc32(data);
+		if ((offset + packed.data.length + 30 + name.length) > 0xFFFFFFFF) {
+			console.error("Theme packs larger than 4 GiB are not supported.");
+			process.exit(1);
+		}
+
+		// zstd requires version 6.3 of the specification to extract.
+		let version = (packed.method == ZIP_METHOD_ZSTD) ? 63 : 20;
+		let header = Buffer.alloc(30);
+		header.writeUInt32LE(0x04034b50, 0);
+		header.writeUInt16LE(version, 4);
+		header.writeUInt16LE(0x0800, 6); // Names are UTF-8.
+		header.writeUInt16LE(packed.method, 8);
+		header.writeUInt16LE(time.time, 10);
+		header.writeUInt16LE(time.date, 12);
+		header.writeUInt32LE(crc, 14);
+		header.writeUInt32LE(packed.data.length, 18);
+		header.writeUInt32LE(data.length, 22);
+		header.writeUInt16LE(name.length, 26);
+		header.writeUInt16LE(0, 28);
+
+		let record = Buffer.alloc(46);
+		record.writeUInt32LE(0x02014b50, 0);
+		record.writeUInt16LE(version, 4);
+		header.copy(record, 6, 4, 30);
+		record.writeUInt32LE(offset, 42);
+		central.push(Buffer.concat([record, name]));
+
+		write(header);
+		write(name);
+		write(packed.data);
+	}
+	if (central.length > 0xFFFF) {
+		console.error("Theme packs with more than 65535 files are not supported.");
+		process.exit(1);
+	}
+
+	let directory_offset = offset;
+	for (let record of central) {
+		write(record);
+	}
+	let end = Buffer.alloc(22);
+	end.writeUInt32LE(0x06054b50, 0);
+	end.writeUInt16LE(central.length, 8);
+	end.writeUInt16LE(central.length, 10);
+	end.writeUInt32LE(offset - directory_offset, 12);
+	end.writeUInt32LE(directory_offset, 16);
+	write(end);
+	fs.closeSync(output);
+}
+
+if (pack_file) {
+	write_pack(pack_file, path_output, pack_zstd);
+}
@@ -0,0 +1,235 @@
+let process = require('process');
+let child_process = require('child_process');
+let crypto = require('crypto');
+let fs = require('fs');
+let http = require('http');
+let path = require('path');
+
+// Configuration
+let options = {
+	"port": 8080,
+	"latency": 0,
+	"throughput": 0,
+	"chunk": 16384,
+	"ranges": true,
+	"fail-rate": 0,
+	"fail-count": 0,
+	"fail-after": 0,
+	"fail-status": "503",
+	"cache-control": "max-age=60",
+	"weak-etags": false,
+	"packs": path.join('.', 'packs'),
+	"pack-size": 64 * 1024 * 1024,
+	"release": "1.0.0",
+};
+let command = [];
+for (let [index, arg] of process.argv.slice(2).entries()) {
+	if (arg == "--") {
+		command = process.argv.slice(index + 3);
+		break;
+	}
+	let match = /^--([a-z-]+)(?:=(.*))?$/.exec(arg);
+	if (!match) {
+		console.error(`Unknown argument '${arg}'.`);
+		process.exit(1);
+	}
+	if (match[1] == "no-ranges") {
+		options.ranges = false;
+	} else if (match[1] == "weak-etags") {
+		options["weak-etags"] = true;
+	} else if (match[1] in options) {
+		let value = match[2] || "";
+		options[match[1]] = (typeof (options[match[1]]) == "number") ? Number(value) : value;
+	} else {
+		console.error(`Unknown option '--${match[1]}'.`);
+		process.exit(1);
+	}
+}
+
+function make_etag(data) {
+	let etag = '"' + crypto.createHash('sha1').update(data).digest('hex') + '"';
+	return options["weak-etags"] ? ("W/" + etag) : etag;
+}
+
+// Canned responses
+let releases = JSON.stringify([
+	{ "tag_name": options.release, "prerelease": false, "name": `OWN3D Pro ${options.release}` },
+	{ "tag_name": "99.0.0e1", "prerelease": true, "name": "OWN3D Pro Testing" },
+]);
+let releases_etag = make_etag(releases);
+let releases_modified = new Date().toUTCString();
+
+let generated_packs = {};
+function generated_pack(name) {
+	// Deterministic content, so that resumed and segmented downloads can be verified.
+	if (!(name in generated_packs)) {
+		let data = Buffer.alloc(options["pack-size"]);
+		let seed = crypto.createHash('sha256').update(name).digest();
+		for (let offset = 0; offset < data.length; offset += seed.length) {
+			seed = crypto.createHash('sha256').update(seed).digest();
+			seed.copy(data, offset);
+		}
+		generated_packs[name] = data;
+	}
+	return generated_packs[name];
+}
+
+function find_pack(name, query) {
+	let file = path.join(options.packs, path.basename(name));
+	if (fs.existsSync(file)) {
+		let stats = fs.statSync(file);
+		return { "data": fs.readFileSync(file), "modified": stats.mtime };
+	}
+	// The query picks a different version of the generated pack, as if it had been updated.
+	return { "data": generated_pack(name + query), "modified": new Date(0) };
+}
+
+// Sends the body in chunks, at the configured throughput, and optionally drops the connection halfway through.
+function send_body(response, body, drop) {
+	let offset = 0;
+	let limit = drop ? Math.floor(body.length / 2) : body.length;
+	let interval = (options.throughput > 0) ? (options.chunk * 1000 / options.throughput) : 0;
+	function next() {
+		if (offset >= limit) {
+			if (drop) {
+				response.socket.destroy();
+			} else {
+				response.end();
+			}
+			return;
+		}
+		let chunk = body.subarray(offset, Math.min(offset + options.chunk, limit));
+		offset += chunk.length;
+		if (response.write(chunk) || (interval > 0)) {
+			setTimeout(next, interval);
+		} else {
+			response.once('drain', next);
+		}
+	}
+	next();
+}
+
+function handle_releases(request, response, drop) {
+	let headers = {
+		"Content-Type": "application/json",
+		"Cache-Control": options["cache-control"],
+		"ETag": releases_etag,
+		"Last-Modified": releases_modified,
+	};
+	if ((request.headers["if-none-match"] == releases_etag)
+		|| (request.headers["if-modified-since"] == releases_modified)) {
+		response.writeHead(304, headers);
+		response.end();
+		return;
+	}
+	headers["Content-Length"] = Buffer.byteLength(releases);
+	response.writeHead(200, headers);
+	send_body(response, Buffer.from(releases), drop);
+}
+
+function handle_token(request, response, drop) {
+	let token = crypto.randomBytes(32).toString('hex');
+	response.writeHead(200, { "Content-Type": "text/plain", "Content-Length": token.length });
+	send_body(response, Buffer.from(token), drop);
+}
+
+function handle_pack(request, response, name, query, drop) {
+	let pack = find_pack(name, query);
+	let etag = make_etag(pack.data);
+	let modified = pack.modified.toUTCString();
+	let headers = {
+		"Content-Type": "application/octet-stream",
+		"ETag": etag,
+		"Last-Modified": modified,
+	};
+	if (options.ranges) {
+		headers["Accept-Ranges"] = "bytes";
+	}
+	if (request.method == "HEAD") {
+		headers["Content-Length"] = pack.data.length;
+		response.writeHead(200, headers);
+		response.end();
+		return;
+	}
+
+	// Only honour ranges if the file didn't change since the client got its first part.
+	let range = options.ranges ? request.headers["range"] : undefined;
+	let if_range = request.headers["if-range"];
+	// Weak entity tags never match in If-Range.
+	let unchanged = !if_range || ((if_range == etag) && !etag.startsWith("W/")) || (if_range == modified);
+	if (range && unchanged) {
+		let match = /^bytes=(\d*)-(\d*)$/.exec(range);
+		let start = (match && match[1] != "") ? Number(match[1]) : 0;
+		let end = (match && match[2] != "") ? Math.min(Number(match[2]), pack.data.length - 1) : pack.data.length - 1;
+		if (!match || (start >= pack.data.length) || (start > end)) {
+			response.writeHead(416, { "Content-Range": `bytes */${pack.data.length}` });
+			response.end();
+			return;
+		}
+		headers["Content-Range"] = `bytes ${start}-${end}/${pack.data.length}`;
+		headers["Content-Length"] = end - start + 1;
+		response.writeHead(206, headers);
+		send_body(response, pack.data.subarray(start, end + 1), drop);
+		return;
+	}
+
+	headers["Content-Length"] = pack.data.length;
+	response.writeHead(200, headers);
+	send_body(response, pack.data, drop);
+}
+
+let requests = 0;
+let server = http.createServer((request, response) => {
+	let url = new URL(request.url, `http://${request.headers.host || "localhost"}`);
+	console.log(`${request.method} ${url.pathname} ${request.headers["range"] || ""}`);
+
+	setTimeout(() => {
+		// Failure injection
+		let drop = false;
+		let inject = (requests++ >= options["fail-after"]);
+		let fail = inject && ((options["fail-count"] > 0) || (Math.random() < options["fail-rate"]));
+		if (inject) {
+			options["fail-count"] = Math.max(options["fail-count"] - 1, 0);
+		}
+		if (fail) {
+			if (options["fail-status"] == "drop") {
+				drop = true;
+			} else {
+				response.writeHead(Number(options["fail-status"]), { "Content-Type": "text/plain", "Retry-After": "1" });
+				response.end("Injected failure.");
+				return;
+			}
+		}
+
+		let pack = /^\/packs\/([^/]+\.pack)$/.exec(url.pathname);
+		if ((request.method == "POST") && (url.pathname == "/api/v1/machine-tokens/issue")) {
+			handle_token(request, response, drop);
+		} else if ((request.method == "GET") && (url.pathname == "/api/v1/obs/releases")) {
+			handle_releases(request, response, drop);
+		} else if (((request.method == "GET") || (request.method == "HEAD")) && pack) {
+			handle_pack(request, response, pack[1], url.search, drop);
+		} else {
+			response.writeHead(404, { "Content-Type": "text/plain" });
+			response.end("Not found.");
+		}
+	}, options.latency);
+});
+server.listen(options.port, "127.0.0.1", () => {
+	let endpoint = `http://127.0.0.1:${server.address().port}/`;
+	console.log(`Listening on ${endpoint}`);
+
+	// Run the command against this server, and exit with its result.
+	if (command.length > 0) {
+		let child = child_process.spawn(command[0], command.slice(1), {
+			"stdio": "inherit",
+			"env": Object.assign({}, process.env, { "OWN3D_ENDPOINT": endpoint }),
+		});
+		child.on('error', (error) => {
+			console.error(`Failed to run '${command[0]}': ${error.message}`);
+			process.exit(1);
+		});
+		child.on('exit', (code, signal) => {
+			process.exit((code != null) ? code : 1);
+		});
+	}
+});